@@ -0,0 +1,94 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CoreServicesStub.h"
+
+#include <atomic>
+#include <iostream>
+
+// Read by the receive thread and the audio loop
+static std::atomic<bool> s_acquiring (false);
+static std::atomic<int64> s_globalTimestamp (0);
+static std::atomic<float> s_sampleRate (30000.0f);
+
+void CoreServicesStub::setGlobalSampleRate (float sampleRate)
+{
+    s_sampleRate = sampleRate;
+}
+
+void CoreServicesStub::setAcquisitionStatus (bool acquiring)
+{
+    s_acquiring = acquiring;
+}
+
+void CoreServicesStub::advanceGlobalTimestamp (int64 samples)
+{
+    s_globalTimestamp += samples;
+}
+
+void CoreServices::sendStatusMessage (const String& text)
+{
+    std::cout << "[status] " << text << std::endl;
+}
+
+bool CoreServices::getAcquisitionStatus()
+{
+    return s_acquiring;
+}
+
+bool CoreServices::getRecordingStatus()
+{
+    return false;
+}
+
+int64 CoreServices::getGlobalTimestamp()
+{
+    return s_globalTimestamp;
+}
+
+int64 CoreServices::getSoftwareTimestamp()
+{
+    return Time::getHighResolutionTicks();
+}
+
+float CoreServices::getGlobalSampleRate()
+{
+    return s_sampleRate;
+}
+
+float CoreServices::getSoftwareSampleRate()
+{
+    return float (Time::getHighResolutionTicksPerSecond());
+}
+
+void CoreServices::updateSignalChain (GenericEditor* source)
+{
+}
@@ -0,0 +1,48 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORESERVICESSTUB_H
+#define CORESERVICESSTUB_H
+
+#include <ProcessorHeaders.h>
+
+/**
+    Controls what the stubbed CoreServices report. The benchmark plays the part of
+    the GUI: it starts acquisition and advances the sample clock block by block.
+*/
+namespace CoreServicesStub
+{
+    void setGlobalSampleRate (float sampleRate);
+    void setAcquisitionStatus (bool acquiring);
+    void advanceGlobalTimestamp (int64 samples);
+}
+
+#endif  // CORESERVICESSTUB_H
@@ -0,0 +1,88 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCHMARK_EDITORHEADERS_H
+#define BENCHMARK_EDITORHEADERS_H
+
+/**
+    Stand-in for the editor headers of the Open Ephys plugin API. TrackingNode
+    creates its editor on demand, so the editor is only built here, never shown.
+*/
+
+#include "ProcessorHeaders.h"
+
+class UtilityButton : public Button
+{
+public:
+    UtilityButton (const String& label, const Font& font)
+        : Button (label), m_font (font), m_radius (5.0f)
+    {
+    }
+
+    void setRadius (float radius) { m_radius = radius; }
+    void setEnabledState (bool state) { setEnabled (state); }
+
+protected:
+    void paintButton (Graphics& g, bool isMouseOver, bool isButtonDown) override {}
+
+private:
+    Font m_font;
+    float m_radius;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (UtilityButton);
+};
+
+class GenericEditor : public AudioProcessorEditor, public Button::Listener
+{
+public:
+    GenericEditor (GenericProcessor* owner, bool useDefaultParameterEditors)
+        : desiredWidth (150), titleFont ("Default", 14, Font::plain), m_processor (owner)
+    {
+    }
+    virtual ~GenericEditor() {}
+
+    GenericProcessor* getProcessor() const { return m_processor; }
+
+    virtual void buttonEvent (Button* button) {}
+    virtual void updateSettings() {}
+    void buttonClicked (Button* button) override { buttonEvent (button); }
+
+protected:
+    int desiredWidth;
+    Font titleFont;
+
+private:
+    GenericProcessor* m_processor;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GenericEditor);
+};
+
+#endif  // BENCHMARK_EDITORHEADERS_H
@@ -0,0 +1,416 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCHMARK_PROCESSORHEADERS_H
+#define BENCHMARK_PROCESSORHEADERS_H
+
+/**
+    Stand-in for the processor headers of the Open Ephys plugin API, limited to what
+    the Tracking Port uses, so that TrackingNode runs outside of the GUI in the
+    ingest benchmark. Channels keep their metadata, and events are serialized into
+    a scratch buffer, as the GUI does before sending them down the signal chain,
+    then counted and dropped. CoreServices is implemented by CoreServicesStub.cpp.
+*/
+
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+#include <juce_data_structures/juce_data_structures.h>
+#include <juce_graphics/juce_graphics.h>
+#include <juce_gui_basics/juce_gui_basics.h>
+#include <juce_audio_basics/juce_audio_basics.h>
+
+using namespace juce;
+
+#define BENCHMARK_EVENT_BUFFER_SIZE 65536
+
+class GenericEditor;
+
+namespace CoreServices
+{
+    void sendStatusMessage (const String& text);
+    bool getAcquisitionStatus();
+    bool getRecordingStatus();
+    int64 getGlobalTimestamp();
+    int64 getSoftwareTimestamp();
+    float getGlobalSampleRate();
+    float getSoftwareSampleRate();
+    void updateSignalChain (GenericEditor* source);
+}
+
+enum ProcessorType
+{
+    PROCESSOR_TYPE_FILTER,
+    PROCESSOR_TYPE_SOURCE,
+    PROCESSOR_TYPE_SINK,
+    PROCESSOR_TYPE_SPLITTER,
+    PROCESSOR_TYPE_MERGER,
+    PROCESSOR_TYPE_UTILITY
+};
+
+class MetaDataDescriptor : public ReferenceCountedObject
+{
+public:
+    enum MetaDataTypes { CHAR, INT8, UINT8, INT16, UINT16, INT32, UINT32, INT64, UINT64, FLOAT, DOUBLE };
+
+    MetaDataDescriptor (MetaDataTypes type, unsigned int length, const String& name,
+                        const String& description, const String& identifier)
+        : m_type (type), m_length (length), m_name (name), m_description (description), m_identifier (identifier)
+    {
+    }
+
+    MetaDataTypes getType() const { return m_type; }
+    unsigned int getLength() const { return m_length; }
+    size_t getDataSize() const { return m_length * getTypeSize (m_type); }
+    String getName() const { return m_name; }
+    String getDescription() const { return m_description; }
+    String getIdentifier() const { return m_identifier; }
+
+    static size_t getTypeSize (MetaDataTypes type)
+    {
+        switch (type)
+        {
+            case INT16: case UINT16: return 2;
+            case INT32: case UINT32: case FLOAT: return 4;
+            case INT64: case UINT64: case DOUBLE: return 8;
+            default: return 1;
+        }
+    }
+
+private:
+    MetaDataTypes m_type;
+    unsigned int m_length;
+    String m_name;
+    String m_description;
+    String m_identifier;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MetaDataDescriptor);
+};
+
+class MetaDataValue : public ReferenceCountedObject
+{
+public:
+    MetaDataValue (MetaDataDescriptor::MetaDataTypes type, unsigned int length)
+        : m_type (type), m_length (length), m_size (length * MetaDataDescriptor::getTypeSize (type)), m_data (m_size, true)
+    {
+    }
+    MetaDataValue (const MetaDataDescriptor& descriptor)
+        : MetaDataValue (descriptor.getType(), descriptor.getLength())
+    {
+    }
+
+    MetaDataValue* clone() const
+    {
+        MetaDataValue* value = new MetaDataValue (m_type, m_length);
+        std::memcpy (value->m_data, m_data, m_size);
+        return value;
+    }
+
+    void setValue (const String& data)
+    {
+        jassert (m_type == MetaDataDescriptor::CHAR);
+        std::memset (m_data, 0, m_size);
+        data.copyToUTF8 (m_data, m_size);
+    }
+    template <typename T>
+    void setValue (T data)
+    {
+        jassert (sizeof (T) == MetaDataDescriptor::getTypeSize (m_type));
+        std::memcpy (m_data, &data, jmin (sizeof (T), m_size));
+    }
+
+    void getValue (String& data) const { data = String::fromUTF8 (m_data, int (strnlen (m_data, m_size))); }
+    template <typename T>
+    void getValue (T& data) const { std::memcpy (&data, m_data, jmin (sizeof (T), m_size)); }
+
+    const void* getRawValuePointer() const { return m_data; }
+    size_t getDataSize() const { return m_size; }
+
+private:
+    MetaDataDescriptor::MetaDataTypes m_type;
+    unsigned int m_length;
+    size_t m_size;
+    HeapBlock<char> m_data;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MetaDataValue);
+};
+
+typedef ReferenceCountedObjectPtr<MetaDataDescriptor> MetaDataDescriptorPtr;
+typedef ReferenceCountedObjectPtr<MetaDataValue> MetaDataValuePtr;
+typedef ReferenceCountedArray<MetaDataValue, CriticalSection> MetaDataValueArray;
+
+class MetaDataEventObject
+{
+public:
+    void addEventMetaData (MetaDataDescriptor* descriptor) { m_eventMetaData.add (descriptor); }
+    int getEventMetaDataCount() const { return m_eventMetaData.size(); }
+
+private:
+    ReferenceCountedArray<MetaDataDescriptor> m_eventMetaData;
+};
+
+class MetaDataInfoObject
+{
+public:
+    void addMetaData (MetaDataDescriptor* descriptor, MetaDataValue* value)
+    {
+        m_metaDataDescriptors.add (descriptor);
+        m_metaDataValues.add (value);
+    }
+    void addMetaData (const MetaDataDescriptor& descriptor, const MetaDataValue& value)
+    {
+        addMetaData (new MetaDataDescriptor (descriptor.getType(), descriptor.getLength(), descriptor.getName(),
+                                             descriptor.getDescription(), descriptor.getIdentifier()),
+                     value.clone());
+    }
+    const MetaDataDescriptor* getMetaDataDescriptor (int index) const { return m_metaDataDescriptors[index]; }
+    const MetaDataValue* getMetaDataValue (int index) const { return m_metaDataValues[index]; }
+    int getMetaDataCount() const { return m_metaDataValues.size(); }
+
+private:
+    ReferenceCountedArray<MetaDataDescriptor> m_metaDataDescriptors;
+    ReferenceCountedArray<MetaDataValue> m_metaDataValues;
+};
+
+class GenericProcessor;
+
+class EventChannel : public MetaDataEventObject, public MetaDataInfoObject
+{
+public:
+    enum EventChannelTypes
+    {
+        TTL = 3,
+        TEXT = 5,
+        INT8_ARRAY = 10, UINT8_ARRAY, INT16_ARRAY, UINT16_ARRAY, INT32_ARRAY, UINT32_ARRAY,
+        INT64_ARRAY, UINT64_ARRAY, FLOAT_ARRAY, DOUBLE_ARRAY,
+        INVALID
+    };
+
+    EventChannel (EventChannelTypes type, unsigned int numChannels, unsigned int dataLength,
+                  float sampleRate, GenericProcessor* source, uint16 subProcessorIdx = 0)
+        : m_type (type), m_numChannels (numChannels), m_length (dataLength), m_sampleRate (sampleRate), m_source (source)
+    {
+    }
+
+    void setName (const String& name) { m_name = name; }
+    void setDescription (const String& description) { m_description = description; }
+    void setIdentifier (const String& identifier) { m_identifier = identifier; }
+    String getName() const { return m_name; }
+    String getDescription() const { return m_description; }
+    String getIdentifier() const { return m_identifier; }
+
+    EventChannelTypes getChannelType() const { return m_type; }
+    unsigned int getNumChannels() const { return m_numChannels; }
+    unsigned int getLength() const { return m_length; }
+    float getSampleRate() const { return m_sampleRate; }
+
+private:
+    EventChannelTypes m_type;
+    unsigned int m_numChannels;
+    unsigned int m_length;
+    float m_sampleRate;
+    GenericProcessor* m_source;
+    String m_name;
+    String m_description;
+    String m_identifier;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (EventChannel);
+};
+
+class Event
+{
+public:
+    virtual ~Event() {}
+
+    const EventChannel* getChannelInfo() const { return m_channel; }
+    int64 getTimestamp() const { return m_timestamp; }
+
+    /** Size of the event as serialized by serialize() */
+    size_t getSerializedSize() const
+    {
+        size_t size = sizeof (int64) + m_dataSize;
+        for (int i = 0; i < m_metaData.size(); i++)
+            size += m_metaData.getUnchecked (i)->getDataSize();
+        return size;
+    }
+    /** Timestamp, payload, then metadata values, as the GUI lays out its events */
+    void serialize (void* destination, size_t size) const
+    {
+        jassert (size >= getSerializedSize());
+        char* data = static_cast<char*> (destination);
+        std::memcpy (data, &m_timestamp, sizeof (int64));
+        data += sizeof (int64);
+        std::memcpy (data, m_data, m_dataSize);
+        data += m_dataSize;
+        for (int i = 0; i < m_metaData.size(); i++)
+        {
+            const MetaDataValue* value = m_metaData.getUnchecked (i);
+            std::memcpy (data, value->getRawValuePointer(), value->getDataSize());
+            data += value->getDataSize();
+        }
+    }
+
+protected:
+    Event (const EventChannel* channel, int64 timestamp, const void* data, size_t dataSize,
+           const MetaDataValueArray& metaData)
+        : m_channel (channel), m_timestamp (timestamp), m_dataSize (dataSize), m_data (dataSize), m_metaData (metaData)
+    {
+        std::memcpy (m_data, data, dataSize);
+    }
+
+private:
+    const EventChannel* m_channel;
+    int64 m_timestamp;
+    size_t m_dataSize;
+    HeapBlock<char> m_data;
+    MetaDataValueArray m_metaData;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Event);
+};
+
+class BinaryEvent;
+typedef ScopedPointer<BinaryEvent> BinaryEventPtr;
+
+class BinaryEvent : public Event
+{
+public:
+    static BinaryEventPtr createBinaryEvent (const EventChannel* channel, int64 timestamp, const void* data,
+                                             int dataSize, const MetaDataValueArray& metaData = MetaDataValueArray(),
+                                             uint16 channelIdx = 0)
+    {
+        return new BinaryEvent (channel, timestamp, data, size_t (dataSize), metaData);
+    }
+
+private:
+    BinaryEvent (const EventChannel* channel, int64 timestamp, const void* data, size_t dataSize,
+                 const MetaDataValueArray& metaData)
+        : Event (channel, timestamp, data, dataSize, metaData)
+    {
+    }
+};
+
+class TextEvent;
+typedef ScopedPointer<TextEvent> TextEventPtr;
+
+class TextEvent : public Event
+{
+public:
+    static TextEventPtr createTextEvent (const EventChannel* channel, int64 timestamp, const String& text,
+                                         uint16 channelIdx = 0)
+    {
+        return new TextEvent (channel, timestamp, text);
+    }
+
+private:
+    TextEvent (const EventChannel* channel, int64 timestamp, const String& text)
+        : Event (channel, timestamp, text.toRawUTF8(), text.getNumBytesAsUTF8() + 1, MetaDataValueArray())
+    {
+    }
+};
+
+/** Only the owner of an editor here; the benchmark never opens one */
+class AudioProcessorEditor : public Component
+{
+};
+
+class GenericProcessor
+{
+public:
+    GenericProcessor (const String& name)
+        : m_name (name)
+        , m_processorType (PROCESSOR_TYPE_FILTER)
+        , m_timestamp (0)
+        , m_numSamples (0)
+        , m_eventCount (0)
+        , m_eventBytes (0)
+        , m_eventBuffer (BENCHMARK_EVENT_BUFFER_SIZE)
+    {
+    }
+    virtual ~GenericProcessor() {}
+
+    virtual AudioProcessorEditor* createEditor() { return nullptr; }
+    virtual void updateSettings() {}
+    virtual bool enable() { return true; }
+    virtual bool disable() { return true; }
+    virtual bool isReady() { return true; }
+    virtual void process (AudioSampleBuffer& buffer) = 0;
+    virtual void saveCustomParametersToXml (XmlElement* parentElement) {}
+    virtual void loadCustomParametersFromXml() {}
+
+    /** Rebuilds the event channels, as a signal chain update does */
+    void update()
+    {
+        eventChannelArray.clear();
+        updateSettings();
+    }
+
+    String getName() const { return m_name; }
+    ProcessorType getProcessorType() const { return m_processorType; }
+    int getNumInputs() const { return 0; }
+    int getTotalEventChannels() const { return eventChannelArray.size(); }
+    /** Events added since the processor was built, and their serialized size */
+    uint64 getEventCount() const { return m_eventCount; }
+    uint64 getEventBytes() const { return m_eventBytes; }
+
+protected:
+    void setProcessorType (ProcessorType type) { m_processorType = type; }
+    void setTimestampAndSamples (uint64 timestamp, uint32 nSamples, uint16 subProcessorIdx = 0)
+    {
+        m_timestamp = timestamp;
+        m_numSamples = nSamples;
+    }
+    void addEvent (const EventChannel* channel, const Event* event, int sampleNum)
+    {
+        jassert (sampleNum >= 0 && uint32 (sampleNum) < jmax (m_numSamples, uint32 (1)));
+        const size_t size = event->getSerializedSize();
+        if (size <= BENCHMARK_EVENT_BUFFER_SIZE)
+            event->serialize (m_eventBuffer, size);
+        m_eventCount++;
+        m_eventBytes += size;
+    }
+
+    bool sendSampleCount = true;
+    OwnedArray<EventChannel> eventChannelArray;
+    ScopedPointer<XmlElement> parametersAsXml;
+    AudioProcessorEditor* editor = nullptr;
+
+private:
+    String m_name;
+    ProcessorType m_processorType;
+    uint64 m_timestamp;
+    uint32 m_numSamples;
+    uint64 m_eventCount;
+    uint64 m_eventBytes;
+    HeapBlock<char> m_eventBuffer;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GenericProcessor);
+};
+
+#endif  // BENCHMARK_PROCESSORHEADERS_H
@@ -0,0 +1,204 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Ingest benchmark for the Tracking Port: runs a TrackingNode outside of the GUI,
+    feeds its sources with the synthetic tracker of TrackingLoad (or an external
+    tracking_blaster with --external), calls process() on a simulated audio clock,
+    and reports message rate, CPU cost and receive-to-emit latency.
+
+        tracking_benchmark --sources 4 --rate 2000 --seconds 30 --block-size 1024
+
+    Receive CPU is the CPU time of the process less the sender and audio loop
+    threads, so it covers the receive thread: socket, decoding, routing, queueing.
+*/
+
+#include "CoreServicesStub.h"
+#include "TrackingLoad.h"
+#include "../Source/TrackingNode.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <time.h>
+
+using namespace std;
+
+struct BenchmarkSettings
+{
+    int blockSize = 1024;
+    float sampleRate = 30000.0f;
+    bool external = false;
+};
+
+static double getCpuSeconds (clockid_t clock)
+{
+    timespec t;
+    clock_gettime (clock, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static bool parseOption (BenchmarkSettings& settings, int& i, int argc, char** argv)
+{
+    if (strcmp (argv[i], "--external") == 0)
+        settings.external = true;
+    else if (i + 1 >= argc)
+        return false;
+    else if (strcmp (argv[i], "--block-size") == 0)
+        settings.blockSize = jmax (1, atoi (argv[++i]));
+    else if (strcmp (argv[i], "--sample-rate") == 0)
+        settings.sampleRate = jmax (1.0f, float (atof (argv[++i])));
+    else
+        return false;
+    return true;
+}
+
+int main (int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    TrackingLoadSettings load;
+    for (int i = 1; i < argc; i++)
+    {
+        if (! parseOption (settings, i, argc, argv) && ! TrackingLoad::parseOption (load, i, argc, argv))
+        {
+            fprintf (stderr, "usage: %s [options]\n"
+                             "  --block-size N       samples per process() call (1024)\n"
+                             "  --sample-rate HZ     acquisition sample rate (30000)\n"
+                             "  --external           receive from a tracking_blaster instead of sending\n"
+                             "%s", argv[0], TrackingLoad::getOptionsHelp());
+            return strcmp (argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+    load.sources = jlimit (1, MAX_SOURCES, load.sources);
+
+    CoreServicesStub::setGlobalSampleRate (settings.sampleRate);
+
+    static const char* colors[] = { "red", "green", "blue", "magenta", "cyan",
+                                    "orange", "pink", "grey", "violet", "yellow" };
+    TrackingNode node;
+    for (int i = 0; i < load.sources; i++)
+    {
+        node.addSource (load.portPerSource ? load.port + i : load.port, "/source" + String (i + 1), colors[i]);
+        node.setKeypoints (i, load.keypoints);
+        if (node.getBindError (i).isNotEmpty())
+        {
+            fprintf (stderr, "source %d: %s\n", i + 1, node.getBindError (i).toRawUTF8());
+            return 1;
+        }
+    }
+    node.update();
+    node.enable();
+    CoreServicesStub::setAcquisitionStatus (true);
+
+    printf ("%d source(s) at %.0f Hz, %d samples per block at %.0f Hz, %.1f s\n",
+            load.sources, load.rate, settings.blockSize, settings.sampleRate, load.seconds);
+
+    AudioSampleBuffer buffer (1, settings.blockSize);
+    const chrono::duration<double> blockPeriod (settings.blockSize / double (settings.sampleRate));
+    const chrono::duration<double> duration (load.seconds);
+
+    TrackingLoad sender (load);
+    const double startProcessCpu = getCpuSeconds (CLOCK_PROCESS_CPUTIME_ID);
+    thread senderThread;
+    if (! settings.external)
+        senderThread = thread ([&sender] { sender.run(); });
+
+    // The audio loop, paced by the block period. Two more blocks drain the queues.
+    const auto start = chrono::steady_clock::now();
+    const double startLoopCpu = getCpuSeconds (CLOCK_THREAD_CPUTIME_ID);
+    double processCpu = 0;
+    double maxProcessMicros = 0;
+    int64 blocks = 0;
+    for (;; blocks++)
+    {
+        const auto due = start + chrono::duration_cast<chrono::steady_clock::duration> (blockPeriod * double (blocks));
+        if (due - start >= duration + 2 * blockPeriod)
+            break;
+        this_thread::sleep_until (due);
+
+        CoreServicesStub::advanceGlobalTimestamp (settings.blockSize);
+        const double before = getCpuSeconds (CLOCK_THREAD_CPUTIME_ID);
+        node.process (buffer);
+        const double cpu = getCpuSeconds (CLOCK_THREAD_CPUTIME_ID) - before;
+        processCpu += cpu;
+        maxProcessMicros = jmax (maxProcessMicros, cpu * 1e6);
+    }
+
+    const double loopCpu = getCpuSeconds (CLOCK_THREAD_CPUTIME_ID) - startLoopCpu;
+    if (senderThread.joinable())
+        senderThread.join();
+    const double totalCpu = getCpuSeconds (CLOCK_PROCESS_CPUTIME_ID) - startProcessCpu;
+    const double elapsed = chrono::duration<double> (chrono::steady_clock::now() - start).count();
+    CoreServicesStub::setAcquisitionStatus (false);
+
+    uint64 received = 0;
+    uint64 emitted = 0;
+    uint64 latency[STATS_HISTOGRAM_BINS] = {};
+    for (int i = 0; i < load.sources; i++)
+    {
+        const TrackingStatistics* stats = node.getStatistics (i);
+        received += stats->getReceivedCount();
+        emitted += stats->getEmittedCount();
+        uint64 bins[STATS_HISTOGRAM_BINS];
+        stats->getLatencyHistogram (bins);
+        for (int b = 0; b < STATS_HISTOGRAM_BINS; b++)
+            latency[b] += bins[b];
+        printf ("source %d: %s\n", i + 1, node.getStatisticsSummary (i).toRawUTF8());
+    }
+
+    const double receiveCpu = totalCpu - loopCpu - sender.getCpuSeconds();
+    // Packets are only counted by the sender; the ones lost in the kernel are
+    // taken out in proportion
+    double receivedPackets = double (received);
+    if (! settings.external && sender.getSentCount() > 0)
+    {
+        receivedPackets = received * double (sender.getPacketCount()) / sender.getSentCount();
+        printf ("sent %llu messages in %llu packets, %lld not received\n",
+                (unsigned long long) sender.getSentCount(), (unsigned long long) sender.getPacketCount(),
+                (long long) (sender.getSentCount() - received));
+    }
+    printf ("received %llu messages, %.0f per second; emitted %llu, %llu events\n",
+            (unsigned long long) received, received / elapsed, (unsigned long long) emitted,
+            (unsigned long long) node.getEventCount());
+    printf ("receive CPU %.2f us per message, %.2f us per packet\n",
+            received > 0 ? receiveCpu * 1e6 / received : 0.0,
+            receivedPackets > 0 ? receiveCpu * 1e6 / receivedPackets : 0.0);
+    printf ("process() CPU %.1f us per block (max %.1f), %.3f us per message\n",
+            blocks > 0 ? processCpu * 1e6 / blocks : 0.0, maxProcessMicros,
+            emitted > 0 ? processCpu * 1e6 / emitted : 0.0);
+    printf ("receive to emit latency p50 < %.3f ms, p90 < %.3f ms, p99 < %.3f ms, p99.9 < %.3f ms\n",
+            TrackingStatistics::getPercentile (latency, 0.5) / 1000.0,
+            TrackingStatistics::getPercentile (latency, 0.9) / 1000.0,
+            TrackingStatistics::getPercentile (latency, 0.99) / 1000.0,
+            TrackingStatistics::getPercentile (latency, 0.999) / 1000.0);
+    return 0;
+}
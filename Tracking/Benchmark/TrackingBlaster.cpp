@@ -0,0 +1,80 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Load generator for the Tracking Port: sends synthetic tracking messages over
+    UDP at a fixed rate, then reports the achieved rate and its own CPU cost.
+
+        tracking_blaster --sources 4 --rate 2000 --seconds 30
+*/
+
+#include "TrackingLoad.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+static TrackingLoad* s_load = nullptr;
+
+static void handleSignal (int)
+{
+    if (s_load != nullptr)
+        s_load->stop();
+}
+
+int main (int argc, char** argv)
+{
+    TrackingLoadSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        if (! TrackingLoad::parseOption (settings, i, argc, argv))
+        {
+            fprintf (stderr, "usage: %s [options]\n%s", argv[0], TrackingLoad::getOptionsHelp());
+            return strcmp (argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    TrackingLoad load (settings);
+    s_load = &load;
+    signal (SIGINT, handleSignal);
+
+    printf ("Sending %d source(s) at %.0f Hz to %s:%d for %.1f s\n",
+            settings.sources, settings.rate, settings.host.c_str(), settings.port, settings.seconds);
+    load.run();
+
+    const double seconds = load.getElapsedSeconds();
+    printf ("sent %llu messages in %llu packets, %.1f s\n",
+            (unsigned long long) load.getSentCount(), (unsigned long long) load.getPacketCount(), seconds);
+    printf ("rate %.0f messages/s (%.0f packets/s), CPU %.2f us per packet\n",
+            load.getSentCount() / seconds, load.getPacketCount() / seconds,
+            load.getPacketCount() > 0 ? load.getCpuSeconds() * 1e6 / load.getPacketCount() : 0.0);
+    return 0;
+}
@@ -0,0 +1,230 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TrackingLoad.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <time.h>
+
+#define LOAD_PACKET_SIZE 4096
+
+using namespace std;
+
+static double getThreadCpuSeconds()
+{
+    timespec t;
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+TrackingLoad::TrackingLoad (const TrackingLoadSettings& settings)
+    : m_settings (settings)
+    , m_stop (false)
+    , m_sent (0)
+    , m_packets (0)
+    , m_elapsedSeconds (0)
+    , m_cpuSeconds (0)
+    , m_random (12345)
+{
+    const int nSockets = m_settings.portPerSource ? m_settings.sources : 1;
+    for (int i = 0; i < nSockets; i++)
+        m_sockets.push_back (new UdpTransmitSocket (IpEndpointName (m_settings.host.c_str(), m_settings.port + i)));
+
+    for (int i = 0; i < m_settings.sources; i++)
+    {
+        Source source;
+        source.address = "/source" + to_string (i + 1);
+        source.socket = m_settings.portPerSource ? i : 0;
+        source.x = 0.5f;
+        source.y = 0.5f;
+        source.frame = 0;
+        m_sources.push_back (source);
+    }
+}
+
+TrackingLoad::~TrackingLoad()
+{
+    for (UdpTransmitSocket* socket : m_sockets)
+        delete socket;
+}
+
+float TrackingLoad::step()
+{
+    // xorshift32, uniform in [-0.005, 0.005)
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 17;
+    m_random ^= m_random << 5;
+    return (m_random / 4294967296.0f - 0.5f) * 0.01f;
+}
+
+void TrackingLoad::writeMessage (osc::OutboundPacketStream& stream, Source& source, int64_t captureTime)
+{
+    // Random walk in the unit square
+    source.x = min (1.0f, max (0.0f, source.x + step()));
+    source.y = min (1.0f, max (0.0f, source.y + step()));
+
+    stream << osc::BeginMessage (source.address.c_str());
+    if (m_settings.keypoints > 0)
+    {
+        stream << (osc::int32) m_settings.keypoints;
+        for (int k = 0; k < m_settings.keypoints; k++)
+            stream << source.x + 0.01f * k << source.y + 0.01f * k << 0.9f;
+    }
+    else
+    {
+        stream << source.x << source.y << 0.05f << 0.05f;
+        if (m_settings.frameInfo)
+            stream << (osc::int64) captureTime << (osc::int32) source.frame;
+    }
+    stream << osc::EndMessage;
+    source.frame++;
+}
+
+void TrackingLoad::run()
+{
+    char buffer[LOAD_PACKET_SIZE];
+    const double startCpu = getThreadCpuSeconds();
+    const auto start = chrono::steady_clock::now();
+    const chrono::duration<double> period (1.0 / m_settings.rate);
+    const chrono::duration<double> duration (m_settings.seconds);
+
+    for (uint64_t tick = 0; !m_stop.load (memory_order_relaxed); tick++)
+    {
+        const auto due = start + chrono::duration_cast<chrono::steady_clock::duration> (period * double (tick));
+        if (due - start >= duration)
+        {
+            // The last tick is one period before the end of the run
+            this_thread::sleep_until (start + chrono::duration_cast<chrono::steady_clock::duration> (duration));
+            break;
+        }
+        if (chrono::steady_clock::now() < due)
+            this_thread::sleep_until (due);
+
+        const int64_t captureTime = chrono::duration_cast<chrono::microseconds> (
+            chrono::system_clock::now().time_since_epoch()).count();
+
+        if (m_settings.bundle && ! m_settings.portPerSource)
+        {
+            osc::OutboundPacketStream stream (buffer, LOAD_PACKET_SIZE);
+            stream << osc::BeginBundleImmediate;
+            for (Source& source : m_sources)
+                writeMessage (stream, source, captureTime);
+            stream << osc::EndBundle;
+            m_sockets[0]->Send (stream.Data(), stream.Size());
+            m_packets.fetch_add (1, memory_order_relaxed);
+        }
+        else
+        {
+            for (Source& source : m_sources)
+            {
+                osc::OutboundPacketStream stream (buffer, LOAD_PACKET_SIZE);
+                writeMessage (stream, source, captureTime);
+                m_sockets[source.socket]->Send (stream.Data(), stream.Size());
+                m_packets.fetch_add (1, memory_order_relaxed);
+            }
+        }
+        m_sent.fetch_add (m_sources.size(), memory_order_relaxed);
+    }
+
+    m_elapsedSeconds = chrono::duration<double> (chrono::steady_clock::now() - start).count();
+    m_cpuSeconds = getThreadCpuSeconds() - startCpu;
+}
+
+void TrackingLoad::stop()
+{
+    m_stop = true;
+}
+
+uint64_t TrackingLoad::getSentCount() const
+{
+    return m_sent.load();
+}
+
+uint64_t TrackingLoad::getPacketCount() const
+{
+    return m_packets.load();
+}
+
+double TrackingLoad::getElapsedSeconds() const
+{
+    return m_elapsedSeconds;
+}
+
+double TrackingLoad::getCpuSeconds() const
+{
+    return m_cpuSeconds;
+}
+
+bool TrackingLoad::parseOption (TrackingLoadSettings& settings, int& i, int argc, char** argv)
+{
+    const char* option = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+    if (strcmp (option, "--port-per-source") == 0)
+        settings.portPerSource = true;
+    else if (strcmp (option, "--frame-info") == 0)
+        settings.frameInfo = true;
+    else if (strcmp (option, "--bundle") == 0)
+        settings.bundle = true;
+    else if (value == nullptr)
+        return false;
+    else if (strcmp (option, "--host") == 0)
+        settings.host = argv[++i];
+    else if (strcmp (option, "--port") == 0)
+        settings.port = atoi (argv[++i]);
+    else if (strcmp (option, "--sources") == 0)
+        settings.sources = max (1, atoi (argv[++i]));
+    else if (strcmp (option, "--rate") == 0)
+        settings.rate = max (1.0, atof (argv[++i]));
+    else if (strcmp (option, "--seconds") == 0)
+        settings.seconds = max (0.1, atof (argv[++i]));
+    else if (strcmp (option, "--keypoints") == 0)
+        settings.keypoints = max (0, atoi (argv[++i]));
+    else
+        return false;
+    return true;
+}
+
+const char* TrackingLoad::getOptionsHelp()
+{
+    return "  --host HOST          destination (127.0.0.1)\n"
+           "  --port PORT          first destination port (27020)\n"
+           "  --sources N          sources, sending to /source1 ... /sourceN (1)\n"
+           "  --port-per-source    source n sends to port + n - 1\n"
+           "  --rate HZ            messages per second per source (1000)\n"
+           "  --seconds S          duration (10)\n"
+           "  --frame-info         send ,ffffhi with capture time and frame counter\n"
+           "  --keypoints N        send ,ifff... with N keypoints\n"
+           "  --bundle             send the sources of a tick in one OSC bundle\n";
+}
@@ -0,0 +1,111 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACKINGLOAD_H
+#define TRACKINGLOAD_H
+
+#include "../Source/oscpack/ip/UdpSocket.h"
+#include "../Source/oscpack/osc/OscOutboundPacketStream.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+    Settings of a synthetic tracker. Each of the sources sends an OSC message per
+    tick, to its address "/source<n>" on the port (or on port + n - 1 with
+    portPerSource), in one of the wire formats of TrackingServer.
+*/
+struct TrackingLoadSettings
+{
+    std::string host = "127.0.0.1";
+    int port = 27020;
+    int sources = 1;
+    bool portPerSource = false;
+    double rate = 1000;         // messages per second per source
+    double seconds = 10;
+    bool frameInfo = false;     // ,ffffhi instead of ,ffff
+    int keypoints = 0;          // ,ifff... with this many keypoints, if > 0
+    bool bundle = false;        // all the sources of a tick in one OSC bundle
+};
+
+/**
+    This helper class sends the messages of the synthetic tracker at a fixed rate.
+    Ticks follow an absolute schedule: when the sender falls behind (the rate is
+    above the sleep resolution, or a send blocked), the late ticks are sent back
+    to back, so the average rate holds.
+*/
+class TrackingLoad
+{
+public:
+    explicit TrackingLoad (const TrackingLoadSettings& settings);
+    ~TrackingLoad();
+
+    /** Sends until the duration elapses or stop() is called */
+    void run();
+    void stop();
+
+    uint64_t getSentCount() const;
+    uint64_t getPacketCount() const;
+    /** Wall clock and CPU time spent in run(), in seconds */
+    double getElapsedSeconds() const;
+    double getCpuSeconds() const;
+
+    /** Parses the load options shared by the blaster and the benchmark; returns
+        false if the argument is not one of them */
+    static bool parseOption (TrackingLoadSettings& settings, int& i, int argc, char** argv);
+    static const char* getOptionsHelp();
+
+private:
+    struct Source
+    {
+        std::string address;
+        int socket;
+        float x, y;
+        int32_t frame;
+    };
+
+    void writeMessage (osc::OutboundPacketStream& stream, Source& source, int64_t captureTime);
+    float step();
+
+    TrackingLoadSettings m_settings;
+    std::vector<UdpTransmitSocket*> m_sockets;
+    std::vector<Source> m_sources;
+    std::atomic<bool> m_stop;
+    std::atomic<uint64_t> m_sent;
+    std::atomic<uint64_t> m_packets;
+    double m_elapsedSeconds;
+    double m_cpuSeconds;
+    uint32_t m_random;
+};
+
+#endif  // TRACKINGLOAD_H
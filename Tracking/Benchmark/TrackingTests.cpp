@@ -0,0 +1,771 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+    Unit tests of the Tracking plugin, built beside the benchmark against the same
+    plugin API stubs. Returns nonzero if any check fails, so that ctest can run it.
+
+        tracking_tests
+*/
+
+#include "CoreServicesStub.h"
+#include "../Source/TrackingNode.h"
+#include "../Source/TrackingStimulatorZones.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+static TrackingData makeMessage (int index, int numKeypoints = 0)
+{
+    TrackingData message = {};
+    message.timestamp = uint64 (index);
+    message.position.x = float (index);
+    message.numKeypoints = numKeypoints;
+    return message;
+}
+
+class TrackingQueueTests : public UnitTest
+{
+public:
+    TrackingQueueTests() : UnitTest ("TrackingQueue") {}
+
+    void runTest() override
+    {
+        beginTest ("Capacity is rounded up to a power of two, within bounds");
+        {
+            expectEquals (TrackingQueue (100).getCapacity(), 128);
+            expectEquals (TrackingQueue (1).getCapacity(), MIN_BUFFER_SIZE);
+            expectEquals (TrackingQueue (1 << 24).getCapacity(), MAX_BUFFER_SIZE);
+            expect (TrackingQueue().isEmpty());
+        }
+
+        beginTest ("Drop-oldest keeps the newest messages");
+        {
+            TrackingQueue queue (MIN_BUFFER_SIZE, overflow_drop_oldest);
+            const int capacity = queue.getCapacity();
+            const int overflow = 5;
+            for (int i = 0; i < capacity + overflow; i++)
+                expect (queue.push (makeMessage (i)), "push " + String (i) + " was refused");
+
+            expectEquals (queue.getSize(), capacity);
+            expectEquals (queue.getOverrunCount(), uint64 (overflow));
+            expectEquals (queue.getDroppedCount(), uint64 (overflow));
+
+            TrackingData message;
+            for (int i = overflow; i < capacity + overflow; i++)
+            {
+                expect (queue.pop (message));
+                expectEquals (message.timestamp, uint64 (i));
+            }
+            expect (! queue.pop (message));
+        }
+
+        beginTest ("Drop-newest keeps the oldest messages");
+        {
+            TrackingQueue queue (MIN_BUFFER_SIZE, overflow_drop_newest);
+            const int capacity = queue.getCapacity();
+            const int overflow = 5;
+            for (int i = 0; i < capacity + overflow; i++)
+                expectEquals (queue.push (makeMessage (i)), i < capacity);
+
+            expectEquals (queue.getSize(), capacity);
+            expectEquals (queue.getOverrunCount(), uint64 (overflow));
+            expectEquals (queue.getDroppedCount(), uint64 (overflow));
+
+            TrackingData message;
+            for (int i = 0; i < capacity; i++)
+            {
+                expect (queue.pop (message));
+                expectEquals (message.timestamp, uint64 (i));
+            }
+            expect (! queue.pop (message));
+        }
+
+        beginTest ("The policy can change on a full queue");
+        {
+            TrackingQueue queue (MIN_BUFFER_SIZE, overflow_drop_newest);
+            const int capacity = queue.getCapacity();
+            for (int i = 0; i < capacity; i++)
+                queue.push (makeMessage (i));
+            expect (! queue.push (makeMessage (capacity)));
+
+            queue.setOverflowPolicy (overflow_drop_oldest);
+            expectEquals (queue.getOverflowPolicy(), overflow_drop_oldest);
+            expect (queue.push (makeMessage (capacity + 1)));
+
+            TrackingData message;
+            queue.pop (message);
+            expectEquals (message.timestamp, uint64 (1));
+            expectEquals (queue.getDroppedCount(), uint64 (2));
+        }
+
+        beginTest ("Clear discards the unread messages");
+        {
+            TrackingQueue queue (MIN_BUFFER_SIZE);
+            queue.push (makeMessage (0));
+            queue.push (makeMessage (1));
+            queue.clear();
+            expect (queue.isEmpty());
+
+            TrackingData message;
+            queue.push (makeMessage (2));
+            expect (queue.pop (message));
+            expectEquals (message.timestamp, uint64 (2));
+        }
+
+        beginTest ("Concurrent producer and consumer lose nothing but the dropped messages");
+        {
+            const int count = 200000;
+            TrackingQueue queue (MIN_BUFFER_SIZE, overflow_drop_oldest);
+            std::atomic<bool> finished (false);
+            thread producer ([&queue, &finished] {
+                for (int i = 0; i < count; i++)
+                    queue.push (makeMessage (i));
+                finished = true;
+            });
+
+            TrackingData message;
+            int popped = 0;
+            int64 last = -1;
+            bool ordered = true;
+            bool done = false;
+            while (! done)
+            {
+                // Checked before popping, so that the last messages are not missed
+                done = finished;
+                while (queue.pop (message))
+                {
+                    ordered = ordered && int64 (message.timestamp) > last;
+                    last = int64 (message.timestamp);
+                    popped++;
+                }
+            }
+            producer.join();
+
+            expect (ordered, "messages were popped out of order");
+            expectEquals (uint64 (popped) + queue.getDroppedCount(), uint64 (count));
+        }
+
+        beginTest ("Keypoints travel with their message");
+        {
+            const int numKeypoints = 3;
+            TrackingQueue queue (MIN_BUFFER_SIZE, overflow_drop_oldest, numKeypoints);
+            expectEquals (queue.getNumKeypoints(), numKeypoints);
+
+            // Two more than fit, so that the kept keypoints are those of overwritten slots
+            const int count = queue.getCapacity() + 2;
+            TrackingKeypoint keypoints[MAX_KEYPOINTS];
+            for (int i = 0; i < count; i++)
+            {
+                for (int k = 0; k < numKeypoints; k++)
+                    keypoints[k] = { float (i), float (k), 1.0f };
+                queue.push (makeMessage (i, numKeypoints), keypoints);
+            }
+
+            TrackingData message;
+            for (int i = 2; i < count; i++)
+            {
+                expect (queue.pop (message, keypoints));
+                expectEquals (message.numKeypoints, numKeypoints);
+                for (int k = 0; k < numKeypoints; k++)
+                {
+                    expectEquals (keypoints[k].x, float (i));
+                    expectEquals (keypoints[k].y, float (k));
+                }
+            }
+        }
+
+        beginTest ("Keypoints beyond the queue's are cut off");
+        {
+            TrackingQueue queue (MIN_BUFFER_SIZE, overflow_drop_oldest, 2);
+            TrackingKeypoint keypoints[MAX_KEYPOINTS] = {};
+            TrackingData message;
+
+            queue.push (makeMessage (0, MAX_KEYPOINTS), keypoints);
+            expect (queue.pop (message, keypoints));
+            expectEquals (message.numKeypoints, 2);
+
+            // Without keypoints, a message claiming some keeps none
+            queue.push (makeMessage (1, 2));
+            expect (queue.pop (message, keypoints));
+            expectEquals (message.numKeypoints, 0);
+
+            // A queue without keypoints keeps none either
+            TrackingQueue plain (MIN_BUFFER_SIZE);
+            plain.push (makeMessage (2, 2), keypoints);
+            expect (plain.pop (message, keypoints));
+            expectEquals (message.numKeypoints, 0);
+
+            expectEquals (TrackingQueue (MIN_BUFFER_SIZE, overflow_drop_oldest, 1000).getNumKeypoints(), MAX_KEYPOINTS);
+        }
+    }
+};
+
+static TrackingQueueTests trackingQueueTests;
+
+/** The tracker side of a shared memory ring, mapped as TrackingSharedMemory.h tells trackers to */
+class TestTracker
+{
+public:
+    TestTracker (const String& address)
+        : m_header (nullptr)
+        , m_size (sizeof (tracking_shm_header) + TRACKING_SHM_CAPACITY * sizeof (tracking_shm_record))
+    {
+        const int fd = shm_open (TrackingSharedRing::getObjectName (address).toRawUTF8(), O_RDWR, 0);
+        if (fd < 0)
+            return;
+        void* memory = mmap (nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close (fd);
+        if (memory != MAP_FAILED)
+            m_header = static_cast<tracking_shm_header*> (memory);
+    }
+
+    ~TestTracker()
+    {
+        if (m_header != nullptr)
+            munmap (m_header, m_size);
+    }
+
+    bool isMapped() const { return m_header != nullptr; }
+    tracking_shm_header* getHeader() const { return m_header; }
+
+    void write (int index)
+    {
+        tracking_shm_record record = {};
+        record.frame = index;
+        record.x = float (index);
+        tracking_shm_write (m_header, &record);
+    }
+
+    /** Leaves the slot of record index half written, as a tracker preempted mid-write would */
+    void tear (uint64 index)
+    {
+        tracking_shm_records (m_header)[index % TRACKING_SHM_CAPACITY].sequence = 2 * index + 1;
+    }
+
+private:
+    tracking_shm_header* m_header;
+    size_t m_size;
+};
+
+class TrackingSharedRingTests : public UnitTest
+{
+public:
+    TrackingSharedRingTests() : UnitTest ("TrackingSharedRing") {}
+
+    void runTest() override
+    {
+        const String address = "/tracking_tests_" + String (int (getpid()));
+        shm_unlink (TrackingSharedRing::getObjectName (address).toRawUTF8());
+
+        beginTest ("Records are read in order");
+        {
+            TrackingSharedRing ring (address);
+            TestTracker tracker (address);
+            expect (tracker.isMapped(), "cannot map " + ring.getName());
+            if (! tracker.isMapped())
+            {
+                shm_unlink (TrackingSharedRing::getObjectName (address).toRawUTF8());
+                return;
+            }
+            expectEquals (tracker.getHeader()->magic, uint32 (TRACKING_SHM_MAGIC));
+            expectEquals (tracker.getHeader()->capacity, uint32 (TRACKING_SHM_CAPACITY));
+
+            tracking_shm_record record;
+            expect (! ring.read (record));
+            for (int i = 0; i < 3; i++)
+                tracker.write (i);
+            expectReads (ring, 0, 3);
+            expect (! ring.read (record));
+            expectEquals (ring.getDroppedCount(), uint64 (0));
+        }
+
+        beginTest ("Records written before the ring was opened are skipped");
+        {
+            TestTracker tracker (address);
+            tracker.write (3);
+            tracker.write (4);
+            TrackingSharedRing ring (address);
+
+            tracking_shm_record record;
+            expect (! ring.read (record));
+            tracker.write (5);
+            expectReads (ring, 5, 1);
+        }
+
+        beginTest ("A torn record is dropped and skipped");
+        {
+            TrackingSharedRing ring (address);
+            TestTracker tracker (address);
+            const uint64 first = tracker.getHeader()->writeIndex;
+            for (int i = 0; i < 3; i++)
+                tracker.write (int (first) + i);
+            tracker.tear (first + 1);
+
+            expectReads (ring, int (first), 1);
+            expectReads (ring, int (first) + 2, 1);
+            expectEquals (ring.getDroppedCount(), uint64 (1));
+
+            // A complete record whose sequence belongs to another lap is not taken either
+            tracker.write (int (first) + 3);
+            tracking_shm_records (tracker.getHeader())[(first + 3) % TRACKING_SHM_CAPACITY].sequence
+                = 2 * (first + 3 + TRACKING_SHM_CAPACITY) + 2;
+            tracking_shm_record record;
+            expect (! ring.read (record));
+            expectEquals (ring.getDroppedCount(), uint64 (2));
+        }
+
+        beginTest ("A reset ring is read from its new write index");
+        {
+            TrackingSharedRing ring (address);
+            TestTracker tracker (address);
+            for (int i = 0; i < 5; i++)
+                tracker.write (i);
+            tracking_shm_record record;
+            while (ring.read (record)) {}
+
+            // The tracker reinitializes the ring
+            tracking_shm_header* header = tracker.getHeader();
+            memset (tracking_shm_records (header), 0, TRACKING_SHM_CAPACITY * sizeof (tracking_shm_record));
+            header->writeIndex = 0;
+
+            expect (! ring.read (record));
+            tracker.write (0);
+            tracker.write (1);
+            expectReads (ring, 0, 2);
+            expect (! ring.read (record));
+        }
+
+        beginTest ("A reader more than a lap behind loses the oldest records");
+        {
+            TrackingSharedRing ring (address);
+            TestTracker tracker (address);
+            const int first = int (tracker.getHeader()->writeIndex);
+            const int lost = 10;
+            for (int i = 0; i < TRACKING_SHM_CAPACITY + lost; i++)
+                tracker.write (first + i);
+
+            expectReads (ring, first + lost, TRACKING_SHM_CAPACITY);
+            expectEquals (ring.getDroppedCount(), uint64 (lost));
+            tracking_shm_record record;
+            expect (! ring.read (record));
+        }
+
+        beginTest ("A corrupted header cannot make the reader leave the ring");
+        {
+            TrackingSharedRing ring (address);
+            TestTracker tracker (address);
+            tracking_shm_header* header = tracker.getHeader();
+            const int first = int (header->writeIndex);
+            for (int i = 0; i < 4; i++)
+                tracker.write (first + i);
+
+            header->capacity = 1u << 30;
+            expectReads (ring, first, 4);
+
+            // A write index far ahead counts as dropped records, and is read past in
+            // one lap of the ring
+            header->writeIndex += uint64 (1) << 40;
+            tracking_shm_record record;
+            expect (! ring.read (record));
+            expectEquals (ring.getDroppedCount(), uint64 (1) << 40);
+
+            // Reopening reinitializes it
+            TrackingSharedRing reopened (address);
+            expectEquals (header->capacity, uint32 (TRACKING_SHM_CAPACITY));
+            expectEquals (header->writeIndex, uint64 (0));
+        }
+
+        shm_unlink (TrackingSharedRing::getObjectName (address).toRawUTF8());
+    }
+
+private:
+    void expectReads (TrackingSharedRing& ring, int first, int count)
+    {
+        tracking_shm_record record;
+        for (int i = first; i < first + count; i++)
+        {
+            if (! ring.read (record))
+            {
+                expect (false, "record " + String (i) + " is missing");
+                return;
+            }
+            expectEquals (record.frame, int32 (i));
+            expectEquals (record.x, float (i));
+        }
+    }
+};
+
+static TrackingSharedRingTests trackingSharedRingTests;
+
+class TrackingServerTests : public UnitTest
+{
+public:
+    TrackingServerTests() : UnitTest ("TrackingServer") {}
+
+    void runTest() override
+    {
+        const TrackingServer::Route route = TrackingServer::makeRoute ("/red", 3);
+        TrackingData message;
+        TrackingKeypoint keypoints[MAX_KEYPOINTS];
+
+        beginTest ("The position message is decoded");
+        {
+            osc::OutboundPacketStream stream (m_buffer, sizeof (m_buffer));
+            stream << osc::BeginMessage ("/red") << 0.25f << 0.5f << 0.125f << 2.0f << osc::EndMessage;
+            message.numKeypoints = 7;
+            expect (decode (route, stream, message, keypoints));
+            expectPosition (message, 0.25f, 0.5f, 0.125f, 2.0f);
+            expect (! message.hasFrameInfo);
+            expectEquals (message.numKeypoints, 0);
+        }
+
+        beginTest ("The extended message is decoded with its capture time and frame");
+        {
+            const int64 captureTime = 1700000000123456LL;
+            osc::OutboundPacketStream stream (m_buffer, sizeof (m_buffer));
+            stream << osc::BeginMessage ("/red") << 1.0f << -1.0f << 0.0f << 3.5f
+                   << (osc::int64) captureTime << (osc::int32) 4242 << osc::EndMessage;
+            expect (decode (route, stream, message, keypoints));
+            expectPosition (message, 1.0f, -1.0f, 0.0f, 3.5f);
+            expect (message.hasFrameInfo);
+            expectEquals (message.captureTime, captureTime);
+            expectEquals (message.frame, int32 (4242));
+        }
+
+        beginTest ("The keypoint message is decoded and positioned at its centroid");
+        {
+            const float values[] = { 0.2f, 0.4f, 1.0f,   0.6f, 0.8f, 1.0f,   0.9f, 0.9f, 0.0f };
+            const int count = 3;
+            osc::OutboundPacketStream stream (m_buffer, sizeof (m_buffer));
+            stream << osc::BeginMessage ("/red") << (osc::int32) count;
+            for (float value : values)
+                stream << value;
+            stream << osc::EndMessage;
+
+            expect (decode (route, stream, message, keypoints));
+            expectEquals (message.numKeypoints, count);
+            expect (! message.hasFrameInfo);
+            for (int k = 0; k < count; k++)
+            {
+                expectEquals (keypoints[k].x, values[3 * k]);
+                expectEquals (keypoints[k].y, values[3 * k + 1]);
+                expectEquals (keypoints[k].confidence, values[3 * k + 2]);
+            }
+            const TrackingPosition centroid = getKeypointCentroid (keypoints, count);
+            expectPosition (message, centroid.x, centroid.y, centroid.width, centroid.height);
+            expectWithinAbsoluteError (message.position.x, 0.4f, 1e-6f);
+            expectWithinAbsoluteError (message.position.y, 0.6f, 1e-6f);
+        }
+
+        beginTest ("A message with every keypoint is decoded");
+        {
+            expect (decode (route, keypointMessage ("/red", MAX_KEYPOINTS, MAX_KEYPOINTS), message, keypoints));
+            expectEquals (message.numKeypoints, MAX_KEYPOINTS);
+            expectEquals (keypoints[MAX_KEYPOINTS - 1].x, float (MAX_KEYPOINTS - 1));
+        }
+
+        beginTest ("Other addresses are not decoded");
+        {
+            osc::OutboundPacketStream stream (m_buffer, sizeof (m_buffer));
+            stream << osc::BeginMessage ("/blue") << 0.0f << 0.0f << 0.0f << 0.0f << osc::EndMessage;
+            expect (! decode (route, stream, message, keypoints));
+
+            osc::OutboundPacketStream prefix (m_buffer, sizeof (m_buffer));
+            prefix << osc::BeginMessage ("/re") << 0.0f << 0.0f << 0.0f << 0.0f << osc::EndMessage;
+            expect (! decode (route, prefix, message, keypoints));
+
+            osc::OutboundPacketStream longer (m_buffer, sizeof (m_buffer));
+            longer << osc::BeginMessage ("/red/1") << 0.0f << 0.0f << 0.0f << 0.0f << osc::EndMessage;
+            expect (! decode (route, longer, message, keypoints));
+        }
+
+        beginTest ("Other layouts are rejected");
+        {
+            osc::OutboundPacketStream three (m_buffer, sizeof (m_buffer));
+            three << osc::BeginMessage ("/red") << 0.0f << 0.0f << 0.0f << osc::EndMessage;
+            expect (! decode (route, three, message, keypoints), ",fff");
+
+            osc::OutboundPacketStream five (m_buffer, sizeof (m_buffer));
+            five << osc::BeginMessage ("/red") << 0.0f << 0.0f << 0.0f << 0.0f << 0.0f << osc::EndMessage;
+            expect (! decode (route, five, message, keypoints), ",fffff");
+
+            osc::OutboundPacketStream integers (m_buffer, sizeof (m_buffer));
+            integers << osc::BeginMessage ("/red") << (osc::int32) 0 << (osc::int32) 0
+                     << (osc::int32) 0 << (osc::int32) 0 << osc::EndMessage;
+            expect (! decode (route, integers, message, keypoints), ",iiii");
+
+            osc::OutboundPacketStream frameOnly (m_buffer, sizeof (m_buffer));
+            frameOnly << osc::BeginMessage ("/red") << 0.0f << 0.0f << 0.0f << 0.0f
+                      << (osc::int32) 1 << osc::EndMessage;
+            expect (! decode (route, frameOnly, message, keypoints), ",ffffi");
+
+            osc::OutboundPacketStream partial (m_buffer, sizeof (m_buffer));
+            partial << osc::BeginMessage ("/red") << (osc::int32) 1 << 0.0f << 0.0f << osc::EndMessage;
+            expect (! decode (route, partial, message, keypoints), ",iff");
+        }
+
+        beginTest ("Keypoint messages that disagree with their count are rejected");
+        {
+            expect (! decode (route, keypointMessage ("/red", 2, 3), message, keypoints), "count too small");
+            expect (! decode (route, keypointMessage ("/red", 4, 3), message, keypoints), "count too large");
+            expect (! decode (route, keypointMessage ("/red", MAX_KEYPOINTS + 1, MAX_KEYPOINTS + 1),
+                              message, keypoints), "too many keypoints");
+        }
+
+        beginTest ("Truncated and padded messages are rejected");
+        {
+            osc::OutboundPacketStream stream (m_buffer, sizeof (m_buffer));
+            stream << osc::BeginMessage ("/red") << 0.0f << 0.0f << 0.0f << 0.0f << osc::EndMessage;
+            const int size = int (stream.Size());
+            for (int cut = 0; cut < size; cut += 4)
+                expect (! TrackingServer::decodeMessage (route, stream.Data(), cut, message, keypoints),
+                        "truncated to " + String (cut) + " bytes");
+            expect (! TrackingServer::decodeMessage (route, stream.Data(), size + 4, message, keypoints),
+                    "4 bytes too long");
+
+            const osc::OutboundPacketStream& pose = keypointMessage ("/red", 2, 2);
+            const int poseSize = int (pose.Size());
+            expect (! TrackingServer::decodeMessage (route, pose.Data(), poseSize - 4, message, keypoints),
+                    "keypoints truncated");
+        }
+    }
+
+private:
+    bool decode (const TrackingServer::Route& route, const osc::OutboundPacketStream& stream,
+                 TrackingData& message, TrackingKeypoint* keypoints)
+    {
+        return TrackingServer::decodeMessage (route, stream.Data(), int (stream.Size()), message, keypoints);
+    }
+
+    /** A ",ifff..." message announcing count keypoints and holding numKeypoints */
+    const osc::OutboundPacketStream& keypointMessage (const char* address, int count, int numKeypoints)
+    {
+        m_stream.Clear();
+        m_stream << osc::BeginMessage (address) << (osc::int32) count;
+        for (int k = 0; k < numKeypoints; k++)
+            m_stream << float (k) << float (k) << 1.0f;
+        m_stream << osc::EndMessage;
+        return m_stream;
+    }
+
+    void expectPosition (const TrackingData& message, float x, float y, float width, float height)
+    {
+        expectEquals (message.position.x, x);
+        expectEquals (message.position.y, y);
+        expectEquals (message.position.width, width);
+        expectEquals (message.position.height, height);
+    }
+
+    // Zero filled past the messages, so that the oversized reads above stay defined
+    char m_buffer[1024] = {};
+    char m_keypointBuffer[1024] = {};
+    osc::OutboundPacketStream m_stream { m_keypointBuffer, sizeof (m_keypointBuffer) };
+};
+
+static TrackingServerTests trackingServerTests;
+
+class StimZoneIndexTests : public UnitTest
+{
+public:
+    StimZoneIndexTests() : UnitTest ("StimZoneIndex") {}
+
+    void runTest() override
+    {
+        // Fixed seed, so that a failure can be reproduced
+        Random random (0x7e57);
+
+        beginTest ("An empty index has no zones");
+        {
+            std::vector<StimCircle> circles;
+            OwnedArray<StimArea> shapes;
+            StimZoneIndex index;
+            index.build (circles, shapes);
+            expectEquals (index.getNumZones(), 0);
+            expectEquals (index.first (0.5f, 0.5f), -1);
+            std::vector<StimZoneHit> hits;
+            index.query (0.5f, 0.5f, hits);
+            expect (hits.empty());
+        }
+
+        beginTest ("Circles are numbered before the shapes");
+        {
+            std::vector<StimCircle> circles;
+            OwnedArray<StimArea> shapes;
+            shapes.add (new StimRect (0.5f, 0.5f, 0.4f, 0.4f, true));
+            circles.push_back (StimCircle (0.5f, 0.5f, 0.1f, false));
+            StimZoneIndex index;
+            index.build (circles, shapes);
+            expectEquals (index.getNumZones(), 2);
+            expectEquals (index.first (0.5f, 0.5f), 0);
+            expectEquals (index.first (0.35f, 0.5f), 1);
+            expect (! index.getZoneOn (0));
+            expect (index.getZoneOn (1));
+        }
+
+        // From a few zones to more than the STIM_GRID_MAX x STIM_GRID_MAX cells,
+        // sized from dots to zones spanning the whole arena
+        const int counts[] = { 1, 7, 60, 400, 5000 };
+        for (int count : counts)
+        {
+            beginTest ("The index agrees with a scan of " + String (count) + " zones");
+
+            std::vector<StimCircle> circles;
+            OwnedArray<StimArea> shapes;
+            for (int i = 0; i < count; i++)
+                addRandomZone (random, circles, shapes, 2.0f / std::sqrt (float (count)));
+
+            StimZoneIndex index;
+            index.build (circles, shapes);
+            expectEquals (index.getNumZones(), count);
+
+            int wrongHits = 0;
+            int wrongFirst = 0;
+            int wrongDistance = 0;
+            std::vector<int> expected;
+            std::vector<StimZoneHit> hits;
+            for (int p = 0; p < 4000; p++)
+            {
+                // Some positions outside the arena, which fall in the border cells
+                const float x = random.nextFloat() * 1.4f - 0.2f;
+                const float y = random.nextFloat() * 1.4f - 0.2f;
+
+                scan (circles, shapes, x, y, expected);
+                index.query (x, y, hits);
+
+                bool same = hits.size() == expected.size();
+                for (size_t h = 0; same && h < hits.size(); h++)
+                {
+                    same = hits[h].zone == expected[h];
+                    const float distance = getZone (circles, shapes, expected[h])->distanceFromCenter (x, y);
+                    if (same && std::abs (hits[h].distance - distance) > 1e-5f)
+                        wrongDistance++;
+                }
+                if (! same)
+                    wrongHits++;
+                if (index.first (x, y) != (expected.empty() ? -1 : expected[0]))
+                    wrongFirst++;
+            }
+            expectEquals (wrongHits, 0, "positions with the wrong zones");
+            expectEquals (wrongFirst, 0, "positions with the wrong first zone");
+            expectEquals (wrongDistance, 0, "hits with the wrong distance");
+
+            const float nan = std::numeric_limits<float>::quiet_NaN();
+            expectEquals (index.first (nan, 0.5f), -1);
+            expectEquals (index.first (0.5f, nan), -1);
+        }
+    }
+
+private:
+    static void addRandomZone (Random& random, std::vector<StimCircle>& circles,
+                               OwnedArray<StimArea>& shapes, float maxSize)
+    {
+        const float cx = random.nextFloat();
+        const float cy = random.nextFloat();
+        const float a = (0.02f + random.nextFloat()) * maxSize / 2;
+        const float b = (0.02f + random.nextFloat()) * maxSize / 2;
+        const bool on = random.nextBool();
+
+        switch (random.nextInt (4))
+        {
+            case 0:
+                circles.push_back (StimCircle (cx, cy, a, on));
+                break;
+            case 1:
+                shapes.add (new StimRect (cx, cy, 2 * a, 2 * b, on));
+                break;
+            case 2:
+                shapes.add (new StimEllipse (cx, cy, a, b, on));
+                break;
+            default:
+            {
+                // Star shaped, and not always convex
+                const int nVertices = 3 + random.nextInt (6);
+                std::vector<float> xs, ys;
+                for (int v = 0; v < nVertices; v++)
+                {
+                    const float angle = float (2 * M_PI) * (v + 0.8f * random.nextFloat()) / nVertices;
+                    const float radius = a * (0.3f + 0.7f * random.nextFloat());
+                    xs.push_back (cx + radius * std::cos (angle));
+                    ys.push_back (cy + radius * std::sin (angle));
+                }
+                shapes.add (new StimPolygon (xs, ys, on));
+                break;
+            }
+        }
+    }
+
+    static StimArea* getZone (std::vector<StimCircle>& circles, OwnedArray<StimArea>& shapes, int zone)
+    {
+        if (zone < int (circles.size()))
+            return &circles[zone];
+        return shapes[zone - int (circles.size())];
+    }
+
+    /** The zones containing (x, y), found by testing every one */
+    static void scan (std::vector<StimCircle>& circles, OwnedArray<StimArea>& shapes,
+                      float x, float y, std::vector<int>& zones)
+    {
+        zones.clear();
+        const int numZones = int (circles.size()) + shapes.size();
+        for (int zone = 0; zone < numZones; zone++)
+            if (getZone (circles, shapes, zone)->isPositionIn (x, y))
+                zones.push_back (zone);
+    }
+};
+
+static StimZoneIndexTests stimZoneIndexTests;
+
+int main()
+{
+    UnitTestRunner runner;
+    runner.setAssertOnFailure (false);
+    runner.runAllTests();
+
+    int failures = 0;
+    for (int i = 0; i < runner.getNumResults(); i++)
+    {
+        const UnitTestRunner::TestResult* result = runner.getResult (i);
+        printf ("%s / %s: %d passed, %d failed\n", result->unitTestName.toRawUTF8(),
+                result->subcategoryName.toRawUTF8(), result->passes, result->failures);
+        failures += result->failures;
+    }
+    return failures > 0 ? 1 : 0;
+}
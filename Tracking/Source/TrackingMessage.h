@@ -33,6 +33,14 @@
 #define TRACKINGDATA_H
 
 #include <ProcessorHeaders.h>
+#include <unordered_map>
+#include <utility>
+#include <cstring>
+#include <limits>
+
+#define MAX_SOURCES 10
+#define MAX_KEYPOINTS 20
+#define MIN_KEYPOINT_CONFIDENCE 0.5f
 
 struct TrackingPosition {
     float x;
@@ -41,9 +49,35 @@ struct TrackingPosition {
     float height;
 };
 
+struct TrackingKeypoint {
+    float x;
+    float y;
+    float confidence;
+};
+
 struct TrackingData {
     uint64 timestamp;
     TrackingPosition position;
+    // Only sent with the extended ",ffffhi" message
+    bool hasFrameInfo;
+    int64 captureTime; // sender clock, microseconds since the epoch
+    int32 frame;
+    // Only sent with the ",ifff..." keypoint message; position is then derived
+    // from the keypoints. The keypoints themselves travel beside the message (see
+    // TrackingQueue), so that the messages of plain sources stay small.
+    int32 numKeypoints;
+};
+
+/** Payload of the "Tracking frames" channel, which packs the sources of one camera
+    frame into a single event. The position of source i is positions[i], and is only
+    valid if bit i of validMask is set. The color, port and address of each source
+    are channel metadata: a "Sources" count, then color, port and address for each
+    source in turn. */
+struct TrackingFrame {
+    uint32 validMask;
+    int32 frame;       // sender frame counter, -1 if not sent
+    int64 captureTime; // sender clock, microseconds since the epoch, 0 if not sent
+    TrackingPosition positions[MAX_SOURCES];
 };
 
 struct TrackingSources
@@ -56,6 +90,118 @@ struct TrackingSources
     float height;
     String name;
     String color;
+    int64 captureTime;
+    // Keypoints following the position in each event, declared by the channel
+    int numKeypoints;
+    String keypointNames;
 };
 
+/** Downstream processors find the source of a tracking event by the node that
+    produced it and its event channel index, packed by trackingSourceKey(). */
+typedef std::unordered_map<uint64, int> TrackingSourceTable;
+
+inline uint64 trackingSourceKey (int sourceNodeId, int eventIndex)
+{
+    return (uint64 (uint32 (sourceNodeId)) << 32) | uint32 (eventIndex);
+}
+
+/** Frame channels, by the same key: the index of their first source and their
+    number of sources */
+typedef std::unordered_map<uint64, std::pair<int, int>> TrackingFrameTable;
+
+/** The position of a keypoint message: the confidence weighted centroid of the
+    keypoints, and the extent of those with a positive confidence. x and y are NaN
+    if there is none. */
+inline TrackingPosition getKeypointCentroid (const TrackingKeypoint* keypoints, int numKeypoints)
+{
+    TrackingPosition position;
+    float weight = 0;
+    float sumX = 0, sumY = 0;
+    float minX = 0, maxX = 0, minY = 0, maxY = 0;
+    for (int k = 0; k < numKeypoints; k++)
+    {
+        const TrackingKeypoint& keypoint = keypoints[k];
+        if (!(keypoint.confidence > 0))
+            continue;
+        if (weight == 0)
+        {
+            minX = maxX = keypoint.x;
+            minY = maxY = keypoint.y;
+        }
+        weight += keypoint.confidence;
+        sumX += keypoint.confidence * keypoint.x;
+        sumY += keypoint.confidence * keypoint.y;
+        minX = jmin (minX, keypoint.x);
+        maxX = jmax (maxX, keypoint.x);
+        minY = jmin (minY, keypoint.y);
+        maxY = jmax (maxY, keypoint.y);
+    }
+
+    if (weight == 0)
+    {
+        position.x = position.y = std::numeric_limits<float>::quiet_NaN();
+        position.width = position.height = 0;
+        return position;
+    }
+    position.x = sumX / weight;
+    position.y = sumY / weight;
+    position.width = maxX - minX;
+    position.height = maxY - minY;
+    return position;
+}
+
+/** Reads the position of a "Tracking data" event, which holds a TrackingPosition
+    followed by the numKeypoints keypoints its channel declares. With keypoint -1,
+    or out of range, that is the position itself; otherwise keypoint k, with NaN
+    coordinates while its confidence is below MIN_KEYPOINT_CONFIDENCE. */
+inline TrackingPosition readTrackingPosition (const void* payload, int numKeypoints, int keypoint)
+{
+    TrackingPosition position;
+    std::memcpy (&position, payload, sizeof (TrackingPosition));
+    if (keypoint < 0 || keypoint >= numKeypoints)
+    {
+        return position;
+    }
+
+    TrackingKeypoint selected;
+    std::memcpy (&selected, static_cast<const char*> (payload) + sizeof (TrackingPosition)
+                            + keypoint * sizeof (TrackingKeypoint), sizeof (TrackingKeypoint));
+    if (selected.confidence >= MIN_KEYPOINT_CONFIDENCE)
+    {
+        position.x = selected.x;
+        position.y = selected.y;
+    }
+    else
+    {
+        position.x = position.y = std::numeric_limits<float>::quiet_NaN();
+    }
+    return position;
+}
+
+/** Name of keypoint k, from the comma separated names its channel declares */
+inline String getKeypointName (const TrackingSources& source, int keypoint)
+{
+    StringArray names;
+    names.addTokens (source.keypointNames, ",", "");
+    if (keypoint < names.size() && names[keypoint].trim().isNotEmpty())
+        return names[keypoint].trim();
+    return "Keypoint " + String (keypoint + 1);
+}
+
+/** Updates a source with a received position, skipping the coordinates that are
+    NaN, and the (0, 0) position some trackers send when they lose the target. */
+inline void applyTrackingPosition (TrackingSources& source, const TrackingPosition& position)
+{
+    if(!(position.x != position.x || position.y != position.y) && position.x != 0 && position.y != 0)
+    {
+        source.x_pos = position.x;
+        source.y_pos = position.y;
+    }
+    if(!(position.width != position.width || position.height != position.height))
+    {
+        source.width = position.width;
+        source.height = position.height;
+    }
+}
+
 #endif // TRACKINGDATA_H
@@ -33,6 +33,15 @@
 #include "TrackingNodeEditor.h"
 #include "TrackingMessage.h"
 
+#include <cerrno>
+#include <cstring>
+#if ! JUCE_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 //preallocate memory for msg
 #define BUFFER_MSG_SIZE 256
 
@@ -42,10 +51,10 @@ TrackingNode::TrackingNode()
     : GenericProcessor ("Tracking Port")
     , m_startingRecTimeMillis (0)
     , m_startingAcqTimeMillis (0)
-    , m_positionIsUpdated (false)
     , m_isRecordingTimeLogged (false)
     , m_isAcquisitionTimeLogged (false)
     , m_received_msg (0)
+    , m_receiver (new TrackingReceiver())
 {
     setProcessorType (PROCESSOR_TYPE_SOURCE);
     sendSampleCount = false;
@@ -57,16 +66,18 @@ TrackingNode::TrackingNode()
 
     lastNumInputs = 0;
 
+    publishModules();
+    m_receiver->start();
 }
 
 TrackingNode::~TrackingNode()
 {
     for (int i = 0; i< trackingModules.size (); i++)
-    {
-        auto *current = trackingModules.getReference(i);
         std::cout << "Removing source " << i << std::endl;
-        delete current;
-    }
+    deleteModules (trackingModules);
+    m_receiver->stop();
+    reclaimRetired (true);
+    delete m_moduleSnapshot.exchange (nullptr);
 }
 
 AudioProcessorEditor* TrackingNode::createEditor()
@@ -81,43 +92,179 @@ void TrackingNode::updateSettings()
 {
     cout << "Updating settings!" << endl;
     moduleEventChannels.clear();
-    for (int i = 0; i < trackingModules.size(); i++)
+    moduleChannelKeypoints.clear();
+    m_frameChannel = nullptr;
+    if (m_frameChannelMode)
     {
-        //It's going to be raw binary data, so let's make it uint8
-        EventChannel* chan = new EventChannel (EventChannel::UINT8_ARRAY, 1, 16, CoreServices::getGlobalSampleRate(), this);
-        chan->setName ("Tracking data");
-        chan->setDescription ("Tracking data received from Bonsai. x, y, width, height");
-        chan->setIdentifier ("external.tracking.rawData");
-        chan->addEventMetaData(new MetaDataDescriptor(MetaDataDescriptor::CHAR, 15, "Color", "Tracking source color to be displayed", "channelInfo.extra"));
-        chan->addEventMetaData(new MetaDataDescriptor(MetaDataDescriptor::INT32, 1, "Port", "Tracking source OSC port", "channelInfo.extra"));
-        chan->addEventMetaData(new MetaDataDescriptor(MetaDataDescriptor::CHAR, 15, "Address", "Tracking source OSC address", "channelInfo.extra"));
+        const int nSources = jmin (trackingModules.size(), MAX_SOURCES);
+        EventChannel* chan = new EventChannel (EventChannel::UINT8_ARRAY, 1, sizeof(TrackingFrame), CoreServices::getGlobalSampleRate(), this);
+        chan->setName ("Tracking frames");
+        chan->setDescription ("Tracking data of all sources, one event per frame. valid mask, frame, capture time, then x, y, width, height of each source");
+        chan->setIdentifier ("external.tracking.frames");
+        // The source descriptors do not change from event to event, so they are
+        // stored once, with the channel
+        MetaDataDescriptor sourcesDesc (MetaDataDescriptor::INT32, 1, "Sources", "Number of tracking sources in the frames", "channelInfo.extra");
+        MetaDataValue sourcesVal (sourcesDesc);
+        sourcesVal.setValue (nSources);
+        chan->addMetaData (sourcesDesc, sourcesVal);
+        for (int i = 0; i < nSources; i++)
+        {
+            auto *module = trackingModules.getReference (i);
+            const String n (i + 1);
+            MetaDataDescriptor colorDesc (MetaDataDescriptor::CHAR, 15, "Color " + n, "Tracking source color to be displayed", "channelInfo.extra");
+            MetaDataValue colorVal (colorDesc);
+            colorVal.setValue (module->m_color.toLowerCase());
+            chan->addMetaData (colorDesc, colorVal);
+            MetaDataDescriptor portDesc (MetaDataDescriptor::INT32, 1, "Port " + n, "Tracking source OSC port", "channelInfo.extra");
+            MetaDataValue portVal (portDesc);
+            portVal.setValue (module->m_port);
+            chan->addMetaData (portDesc, portVal);
+            MetaDataDescriptor addressDesc (MetaDataDescriptor::CHAR, 15, "Address " + n, "Tracking source OSC address", "channelInfo.extra");
+            MetaDataValue addressVal (addressDesc);
+            addressVal.setValue (module->m_address.toLowerCase());
+            chan->addMetaData (addressDesc, addressVal);
+        }
         eventChannelArray.add (chan);
+        m_frameChannel = chan;
+    }
+    else
+    {
+        for (int i = 0; i < trackingModules.size(); i++)
+        {
+            auto *module = trackingModules.getReference (i);
+            const int numKeypoints = jlimit (0, MAX_KEYPOINTS, module->m_keypoints);
+
+            //It's going to be raw binary data, so let's make it uint8
+            EventChannel* chan = new EventChannel (EventChannel::UINT8_ARRAY, 1,
+                                                   sizeof(TrackingPosition) + numKeypoints * sizeof(TrackingKeypoint),
+                                                   CoreServices::getGlobalSampleRate(), this);
+            chan->setName ("Tracking data");
+            chan->setIdentifier ("external.tracking.rawData");
+            if (numKeypoints == 0)
+            {
+                chan->setDescription ("Tracking data received from Bonsai. x, y, width, height");
+            }
+            else
+            {
+                chan->setDescription ("Tracking data received from Bonsai. x, y, width, height of the keypoint centroid, then x, y, confidence of each keypoint");
+                // The keypoint schema is declared once, with the channel
+                MetaDataDescriptor countDesc (MetaDataDescriptor::INT32, 1, "Keypoints", "Number of keypoints after the position", "channelInfo.extra");
+                MetaDataValue countVal (countDesc);
+                countVal.setValue (numKeypoints);
+                chan->addMetaData (countDesc, countVal);
+                MetaDataDescriptor namesDesc (MetaDataDescriptor::CHAR, module->m_keypointNames.length() + 1, "Keypoint names", "Comma separated keypoint names", "channelInfo.extra");
+                MetaDataValue namesVal (namesDesc);
+                namesVal.setValue (module->m_keypointNames);
+                chan->addMetaData (namesDesc, namesVal);
+            }
+            chan->addEventMetaData(new MetaDataDescriptor(MetaDataDescriptor::CHAR, 15, "Color", "Tracking source color to be displayed", "channelInfo.extra"));
+            chan->addEventMetaData(new MetaDataDescriptor(MetaDataDescriptor::INT32, 1, "Port", "Tracking source OSC port", "channelInfo.extra"));
+            chan->addEventMetaData(new MetaDataDescriptor(MetaDataDescriptor::CHAR, 15, "Address", "Tracking source OSC address", "channelInfo.extra"));
+            chan->addEventMetaData(new MetaDataDescriptor(MetaDataDescriptor::INT64, 1, "Capture time", "Sender capture time in microseconds since the epoch, 0 if not sent", "channelInfo.extra"));
+            chan->addEventMetaData(new MetaDataDescriptor(MetaDataDescriptor::INT32, 1, "Frame", "Sender frame counter, -1 if not sent", "channelInfo.extra"));
+            eventChannelArray.add (chan);
+            moduleEventChannels.add (chan);
+            moduleChannelKeypoints.add (numKeypoints);
+        }
     }
+
+    // One text event per source every STATS_EVENT_INTERVAL_MS, after the data channels
+    EventChannel* statsChan = new EventChannel (EventChannel::TEXT, 1, STATS_EVENT_LENGTH, CoreServices::getGlobalSampleRate(), this);
+    statsChan->setName ("Tracking statistics");
+    statsChan->setDescription ("Periodic ingest statistics of each tracking source");
+    statsChan->setIdentifier ("external.tracking.statistics");
+    eventChannelArray.add (statsChan);
+    m_statisticsChannel = statsChan;
+
     lastNumInputs = getNumInputs();
 }
 
-void TrackingNode::addSource (int port, String address, String color)
+bool TrackingNode::enable()
 {
-    cout << "Adding source" << port << endl;
-    try
+    // The sample clock restarts with every acquisition
+    m_clock.reset();
+    // Room for a block that drains every queue while full, so that process() does
+    // not allocate; it stops draining if sources grow during the acquisition.
+    size_t numEvents = PENDING_EVENTS_RESERVE;
+    size_t numKeypoints = 0;
+    for (int i = 0; i < trackingModules.size(); i++)
     {
-        auto *module = new TrackingModule(port, address, color, this);
-        trackingModules.add (module);
+        const size_t capacity = size_t (trackingModules.getReference (i)->m_messageQueue.load()->getCapacity());
+        numEvents += capacity;
+        if (i < moduleChannelKeypoints.size())
+            numKeypoints += capacity * size_t (moduleChannelKeypoints.getUnchecked (i));
     }
-    catch (const std::runtime_error& e)
+    m_pendingEvents.reserve (numEvents);
+    m_pendingKeypoints.reserve (numKeypoints);
+
+    // Every source starts over: shared memory sources with what is written from now
+    // on, UDP sources by clearing their queue when their first message arrives. The
+    // lock keeps the receive thread out while its frame counters are reset.
     {
-        std::cout << "Add source: " << e.what() << std::endl;
+        const ScopedLock sl (lock);
+        for (int i = 0; i < trackingModules.size(); i++)
+        {
+            auto *module = trackingModules.getReference (i);
+            if (module->m_sharedRing != nullptr)
+            {
+                module->m_sharedRing->skipToLatest();
+                module->m_messageQueue.load()->clear();
+            }
+            else
+            {
+                module->m_clearPending = true;
+            }
+            module->resetFrameCounters();
+            module->m_statistics.reset();
+        }
     }
 
+    m_statisticsReady = false;
+    startTimer (STATS_EVENT_INTERVAL_MS);
+    return true;
+}
+
+bool TrackingNode::disable()
+{
+    stopTimer();
+    return true;
+}
+
+bool TrackingNode::rejectSourceChange (const String& action)
+{
+    // The event channels were created by updateSettings() for the sources at that
+    // time, and process() emits source i on channel i: adding or removing a source
+    // would shift the sources against their channels
+    if (!CoreServices::getAcquisitionStatus())
+        return false;
+
+    CoreServices::sendStatusMessage ("Stop acquisition to " + action + " a tracking source");
+    return true;
+}
+
+void TrackingNode::addSource (int port, String address, String color, int queueSize, overflow_policy policy,
+                              tracking_transport transport)
+{
+    if (rejectSourceChange ("add"))
+        return;
+
+    cout << "Adding source" << port << endl;
+    trackingModules.add (createModule (port, address, color, queueSize, policy, transport, 0, "Add source"));
+    updateRoutingTable();
+    publishModules();
 }
 
 void TrackingNode::addSource ()
 {
+    if (rejectSourceChange ("add"))
+        return;
+
     cout << "Adding empty source" << endl;
     try
     {
         auto *module = new TrackingModule(this);
         trackingModules.add (module);
+        publishModules();
     }
     catch (const std::runtime_error& e)
     {
@@ -128,9 +275,12 @@ void TrackingNode::addSource ()
 
 void TrackingNode::removeSource (int i)
 {
-    auto *current = trackingModules.getReference(i);
-    trackingModules.remove(i);
-    delete current;
+    if (i < 0 || i >= trackingModules.size () || rejectSourceChange ("remove"))
+        return;
+
+    Array<TrackingModule*> removed;
+    removed.add (trackingModules.getReference(i));
+    deleteModules (removed);
 }
 
 bool TrackingNode::isPortUsed(int port)
@@ -145,6 +295,59 @@ bool TrackingNode::isPortUsed(int port)
     return used;
 }
 
+TrackingNode::TrackingModule* TrackingNode::createModule (int port, const String& address, const String& color,
+                                                         int queueSize, overflow_policy policy, tracking_transport transport,
+                                                         int numKeypoints, const String& action)
+{
+    try
+    {
+        return new TrackingModule(port, address, color, this, queueSize, policy, transport, numKeypoints);
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cout << action << ": " << e.what() << std::endl;
+        if (transport == transport_shared_memory)
+            CoreServices::sendStatusMessage (action + ": cannot map the ring of " + address + " (" + e.what() + ")");
+        else
+            CoreServices::sendStatusMessage (action + ": cannot listen on port " + String (port) + " (" + e.what() + ")");
+
+        // Keep the settings on an unbound source, so that it can be edited
+        auto *module = new TrackingModule(this);
+        module->m_port = port;
+        module->m_address = address;
+        module->m_color = color;
+        module->m_transport = transport;
+        module->m_keypoints = numKeypoints;
+        module->m_bindError = e.what();
+        delete module->m_messageQueue.load();
+        module->m_messageQueue = new TrackingQueue (queueSize, policy, numKeypoints);
+        delete module->m_metadata.exchange (module->buildMetadata());
+        return module;
+    }
+}
+
+void TrackingNode::replaceModule (int i, int port, const String& address, tracking_transport transport,
+                                  const String& action)
+{
+    auto *module = trackingModules.getReference (i);
+    String color = module->m_color;
+    int queueSize = module->m_messageQueue.load()->getCapacity();
+    overflow_policy policy = module->m_messageQueue.load()->getOverflowPolicy();
+
+    Array<TrackingModule*> replaced;
+    replaced.add (module);
+
+    // The old module keeps receiving until the new one is routed in its place
+    TrackingModule* replacement = createModule (port, address, color, queueSize, policy, transport,
+                                                module->m_keypoints, action);
+    replacement->m_keypointNames = module->m_keypointNames;
+    replacement->m_latestOnly = module->m_latestOnly.load();
+    replacement->m_maxAgeMs = module->m_maxAgeMs.load();
+
+    trackingModules.set (i, replacement);
+    deleteModules (replaced);
+}
+
 void TrackingNode::setPort (int i, int port)
 {
     if (i < 0 || i >= trackingModules.size ())
@@ -153,22 +356,139 @@ void TrackingNode::setPort (int i, int port)
     }
 
     auto *module = trackingModules.getReference (i);
-    module->m_port = port;
     String address = module->m_address;
-    String color = module->m_color;
     if (address.compare("") != 0)
     {
-        delete module;
-        try
-        {
-            module = new TrackingModule(port, address, color, this);
-			trackingModules.set(i, module);
-        }
-        catch (const std::runtime_error& e)
-        {
-            std::cout << "Set port: " << e.what() << std::endl;
-        }
+        replaceModule (i, port, address, module->m_transport, "Set port");
+    }
+    else
+    {
+        module->m_port = port;
+        replaceMetadata (module);
+    }
+}
+
+String TrackingNode::getBindError(int i)
+{
+    if (i < 0 || i >= trackingModules.size()) {
+        return String();
+    }
+
+    auto *module = trackingModules.getReference (i);
+    return module->m_bindError;
+}
+
+void TrackingNode::setKeypoints (int i, int numKeypoints)
+{
+    if (i < 0 || i >= trackingModules.size ())
+    {
+        return;
+    }
+
+    auto *module = trackingModules.getReference (i);
+    numKeypoints = jlimit (0, MAX_KEYPOINTS, numKeypoints);
+    if (numKeypoints == module->m_keypoints)
+        return;
+
+    // The queue only keeps as many keypoints per message as the source declares
+    const TrackingQueue* queue = module->m_messageQueue;
+    replaceQueue (module, new TrackingQueue (queue->getCapacity(), queue->getOverflowPolicy(), numKeypoints));
+    module->m_keypoints = numKeypoints;
+}
+
+int TrackingNode::getKeypoints(int i)
+{
+    if (i < 0 || i >= trackingModules.size()) {
+        return 0;
+    }
+
+    auto *module = trackingModules.getReference (i);
+    return module->m_keypoints;
+}
+
+void TrackingNode::setKeypointNames (int i, String names)
+{
+    if (i < 0 || i >= trackingModules.size ())
+    {
+        return;
+    }
+
+    auto *module = trackingModules.getReference (i);
+    module->m_keypointNames = names;
+}
+
+String TrackingNode::getKeypointNames(int i)
+{
+    if (i < 0 || i >= trackingModules.size()) {
+        return String();
+    }
+
+    auto *module = trackingModules.getReference (i);
+    return module->m_keypointNames;
+}
+
+void TrackingNode::setLatestOnly (int i, bool latestOnly)
+{
+    if (i < 0 || i >= trackingModules.size ())
+    {
+        return;
+    }
+
+    auto *module = trackingModules.getReference (i);
+    module->m_latestOnly = latestOnly;
+}
+
+bool TrackingNode::getLatestOnly(int i)
+{
+    if (i < 0 || i >= trackingModules.size()) {
+        return false;
     }
+
+    auto *module = trackingModules.getReference (i);
+    return module->m_latestOnly.load();
+}
+
+void TrackingNode::setMaxAge (int i, int maxAgeMs)
+{
+    if (i < 0 || i >= trackingModules.size ())
+    {
+        return;
+    }
+
+    auto *module = trackingModules.getReference (i);
+    module->m_maxAgeMs = jmax (0, maxAgeMs);
+}
+
+int TrackingNode::getMaxAge(int i)
+{
+    if (i < 0 || i >= trackingModules.size()) {
+        return 0;
+    }
+
+    auto *module = trackingModules.getReference (i);
+    return module->m_maxAgeMs.load();
+}
+
+void TrackingNode::setTransport (int i, tracking_transport transport)
+{
+    if (i < 0 || i >= trackingModules.size ())
+    {
+        return;
+    }
+
+    auto *module = trackingModules.getReference (i);
+    if (module->m_transport != transport)
+        replaceModule (i, module->m_port, module->m_address, transport, "Set transport");
+}
+
+tracking_transport TrackingNode::getTransport(int i)
+{
+    if (i < 0 || i >= trackingModules.size()) {
+        return transport_udp;
+    }
+
+    auto *module = trackingModules.getReference (i);
+    return module->m_transport;
 }
 
 int TrackingNode::getPort(int i)
@@ -189,21 +509,15 @@ void TrackingNode::setAddress (int i, String address)
     }
 
     auto *module = trackingModules.getReference (i);
-    module->m_address = address;
     int port = module->m_port;
-    String color = module->m_color;
     if (port != -1)
     {
-        delete module;
-        try
-        {
-            module = new TrackingModule(port, address, color, this);
-			trackingModules.set(i, module);
-        }
-        catch (const std::runtime_error& e)
-        {
-            std::cout << "Set address: " << e.what() << std::endl;
-        }
+        replaceModule (i, port, address, module->m_transport, "Set address");
+    }
+    else
+    {
+        module->m_address = address;
+        replaceMetadata (module);
     }
 }
 
@@ -225,7 +539,7 @@ void TrackingNode::setColor (int i, String color)
 	}
 	auto *module = trackingModules.getReference(i);
 	module->m_color = color;
-	trackingModules.set(i, module);
+	replaceMetadata (module);
 
 }
 
@@ -239,318 +553,1697 @@ String TrackingNode::getColor(int i)
     return module->m_color;
 }
 
-void TrackingNode::process (AudioSampleBuffer&)
+void TrackingNode::setQueueSize (int i, int size)
 {
-    if (!m_positionIsUpdated)
+    if (i < 0 || i >= trackingModules.size ())
     {
         return;
     }
-
-    lock.enter();
-
-    for (int i = 0; i < trackingModules.size (); i++)
+    if (CoreServices::getAcquisitionStatus())
     {
-        auto *module = trackingModules.getReference (i);
-        while (true) {
-            auto *message = module->m_messageQueue->pop ();
-            if (!message) {
-                break;
-            }
-
-            setTimestampAndSamples (uint64(message->timestamp), 0);
-            MetaDataValueArray metadata;
-            MetaDataValuePtr color = new MetaDataValue(MetaDataDescriptor::CHAR, 15);
-            color->setValue(module->m_color.toLowerCase());
-            metadata.add(color);
-            MetaDataValuePtr port = new MetaDataValue(MetaDataDescriptor::INT32, 1);
-            port->setValue(module->m_port);
-            metadata.add(port);
-            MetaDataValuePtr address = new MetaDataValue(MetaDataDescriptor::CHAR, 15);
-            address->setValue(module->m_address.toLowerCase());
-            metadata.add(address);
-            const EventChannel* chan = getEventChannel (getEventChannelIndex (i, getNodeId()));
-            BinaryEventPtr event = BinaryEvent::createBinaryEvent (chan,
-                                                                   message->timestamp,
-                                                                   reinterpret_cast<uint8_t *>(&(message->position)),
-                                                                   sizeof(TrackingPosition),
-                                                                   metadata);
-            addEvent (chan, event, 0);
-        }
+        CoreServices::sendStatusMessage ("Stop acquisition before changing the queue size");
+        return;
     }
 
-    lock.exit();
-    m_positionIsUpdated = false;
+    auto *module = trackingModules.getReference (i);
+    overflow_policy policy = module->m_messageQueue.load()->getOverflowPolicy();
+    replaceQueue (module, new TrackingQueue (size, policy));
+}
+
+int TrackingNode::getQueueSize(int i)
+{
+    if (i < 0 || i >= trackingModules.size()) {
+        return -1;
+    }
 
+    auto *module = trackingModules.getReference (i);
+    return module->m_messageQueue.load()->getCapacity();
 }
 
-int TrackingNode::getTrackingModuleIndex(int port, String address)
+void TrackingNode::setOverflowPolicy (int i, overflow_policy policy)
 {
-    int index = -1;
-    for (int i = 0; i < trackingModules.size (); i++)
+    if (i < 0 || i >= trackingModules.size ())
     {
-        auto *current  = trackingModules.getReference(i);
-        if (current->m_port == port && current->m_address.compare(address) == 0)
-            index = i;
+        return;
     }
-    return index;
+
+    auto *module = trackingModules.getReference (i);
+    module->m_messageQueue.load()->setOverflowPolicy (policy);
 }
 
-int TrackingNode::getNSources()
+overflow_policy TrackingNode::getOverflowPolicy(int i)
 {
-    return trackingModules.size ();
+    if (i < 0 || i >= trackingModules.size()) {
+        return overflow_drop_oldest;
+    }
+
+    auto *module = trackingModules.getReference (i);
+    return module->m_messageQueue.load()->getOverflowPolicy();
 }
 
-void TrackingNode::receiveMessage (int port, String address, const TrackingData &message)
+uint64 TrackingNode::getDroppedCount(int i)
 {
-    int index = getTrackingModuleIndex(port, address);
-    if (index != -1)
-    {
-        auto *selectedModule = trackingModules.getReference (index);
+    if (i < 0 || i >= trackingModules.size()) {
+        return 0;
+    }
 
-        lock.enter();
+    auto *module = trackingModules.getReference (i);
+    uint64 dropped = module->m_messageQueue.load()->getDroppedCount();
+    if (module->m_sharedRing != nullptr)
+        dropped += module->m_sharedRing->getDroppedCount();
+    return dropped;
+}
 
-        if (CoreServices::getRecordingStatus())
-        {
-            if (!m_isRecordingTimeLogged)
-            {
-                m_received_msg = 0;
-                m_startingRecTimeMillis =  Time::currentTimeMillis();
-                m_isRecordingTimeLogged = true;
-                std::cout << "Starting Recording Ts: " << m_startingRecTimeMillis << std::endl;
-                selectedModule->m_messageQueue->clear();
-                CoreServices::sendStatusMessage ("Clearing queue before start recording");
-            }
-        }
-        else
-        {
-            m_isRecordingTimeLogged = false;
-        }
+uint64 TrackingNode::getFrameGapCount(int i)
+{
+    if (i < 0 || i >= trackingModules.size()) {
+        return 0;
+    }
 
+    auto *module = trackingModules.getReference (i);
+    return module->m_frameGaps.load (std::memory_order_relaxed);
+}
 
-        if (CoreServices::getAcquisitionStatus()) // && !CoreServices::getRecordingStatus())
-        {
-            if (!m_isAcquisitionTimeLogged)
-            {
-                m_startingAcqTimeMillis = Time::currentTimeMillis();
-                m_isAcquisitionTimeLogged = true;
-                std::cout << "Starting Acquisition at Ts: " << m_startingAcqTimeMillis << std::endl;
-                selectedModule->m_messageQueue->clear();
-                CoreServices::sendStatusMessage ("Clearing queue before start acquisition");
-            }
+uint64 TrackingNode::getFrameReorderCount(int i)
+{
+    if (i < 0 || i >= trackingModules.size()) {
+        return 0;
+    }
 
-            m_positionIsUpdated = true;
+    auto *module = trackingModules.getReference (i);
+    return module->m_frameReorders.load (std::memory_order_relaxed);
+}
 
-            // NOTE: We cannot trust the getGlobalTimestamp function because it can return
-            // negative time deltas. The reason is unknown.
-            int64 ts = CoreServices::getSoftwareTimestamp();
+const TrackingStatistics* TrackingNode::getStatistics(int i)
+{
+    if (i < 0 || i >= trackingModules.size()) {
+        return nullptr;
+    }
 
-            TrackingData outputMessage = message;
-            outputMessage.timestamp = ts;
-            selectedModule->m_messageQueue->push (outputMessage);
-            m_received_msg++;
-        }
-        else
-            m_isAcquisitionTimeLogged = false;
+    auto *module = trackingModules.getReference (i);
+    return &module->m_statistics;
+}
 
-        lock.exit();
+String TrackingNode::getStatisticsSummary(int i)
+{
+    if (i < 0 || i >= trackingModules.size()) {
+        return String();
     }
 
+    return summarizeStatistics (trackingModules.getReference (i));
 }
 
-bool TrackingNode::isReady()
+String TrackingNode::summarizeStatistics (const TrackingModule* module)
 {
-    return true;
+    const TrackingStatistics& stats = module->m_statistics;
+    const TrackingQueue& queue = *module->m_messageQueue.load();
+
+    uint64 latency[STATS_HISTOGRAM_BINS];
+    stats.getLatencyHistogram (latency);
+
+    return "received " + String (stats.getReceivedCount())
+        + ", " + String (stats.getRate(), 1) + " Hz"
+        + ", jitter " + String (stats.getJitter() / 1000.0, 2) + " ms"
+        + ", malformed " + String (stats.getMalformedCount())
+        + ", overruns " + String (queue.getOverrunCount())
+        + ", dropped " + String (queue.getDroppedCount())
+        + ", frame gaps " + String (module->m_frameGaps.load())
+        + ", coalesced " + String (module->m_coalesced.load())
+        + ", expired " + String (module->m_expired.load())
+        + ", queue " + String (queue.getSize()) + "/" + String (queue.getCapacity())
+        + ", latency p50 < " + String (TrackingStatistics::getPercentile (latency, 0.5) / 1000.0, 3) + " ms"
+        + ", p99 < " + String (TrackingStatistics::getPercentile (latency, 0.99) / 1000.0, 3) + " ms";
 }
 
-void TrackingNode::saveCustomParametersToXml (XmlElement* parentElement)
+void TrackingNode::timerCallback()
 {
-    XmlElement* mainNode = parentElement->createNewChildElement ("TrackingNode");
+    // process() has not emitted the previous texts yet
+    if (m_statisticsReady.load (std::memory_order_acquire))
+        return;
+
+    m_statisticsText.clear();
     for (int i = 0; i < trackingModules.size(); i++)
     {
-        auto *module = trackingModules.getReference (i);
-        XmlElement* source = new XmlElement("Source_"+String(i+1));
-        source->setAttribute ("port", module->m_port);
-        source->setAttribute ("address", module->m_address);
-        source->setAttribute ("color", module->m_color);
-        mainNode->addChildElement(source);
+        String text = "Tracking source " + String (i + 1) + ": " + summarizeStatistics (trackingModules.getReference (i));
+        m_statisticsText.add (text.substring (0, STATS_EVENT_LENGTH - 1));
+    }
+    m_statisticsReady.store (true, std::memory_order_release);
+}
+
+void TrackingNode::setReceiveSettings (const TrackingReceiveSettings& settings)
+{
+    const bool rebind = settings.interfaceAddress != m_receiveSettings.interfaceAddress;
+    const bool restart = settings.threadPriority != m_receiveSettings.threadPriority
+                         || settings.cpu != m_receiveSettings.cpu;
+    m_receiveSettings = settings;
+
+    if (rebind)
+    {
+        for (int i = 0; i < trackingModules.size(); i++)
+        {
+            auto *module = trackingModules.getReference (i);
+            if (module->m_server != nullptr)
+                replaceModule (i, module->m_port, module->m_address, module->m_transport, "Set interface");
+        }
+    }
+
+    for (int i = 0; i < m_servers.size(); i++)
+        m_servers.getUnchecked (i)->applySettings (m_receiveSettings);
+
+    if (restart)
+        m_receiver->configure (m_receiveSettings.threadPriority, m_receiveSettings.cpu);
+}
+
+const TrackingReceiveSettings& TrackingNode::getReceiveSettings() const
+{
+    return m_receiveSettings;
+}
+
+void TrackingNode::setFrameChannelMode (bool frameMode)
+{
+    m_frameChannelMode = frameMode;
+}
+
+bool TrackingNode::getFrameChannelMode() const
+{
+    return m_frameChannelMode;
+}
+
+// Marks a process() call as a reader of the module snapshot, see publishModules()
+class ScopedSnapshotReader
+{
+public:
+    explicit ScopedSnapshotReader (std::atomic<uint64>& epoch) : m_epoch (epoch) { m_epoch++; }
+    ~ScopedSnapshotReader() { m_epoch++; }
+private:
+    std::atomic<uint64>& m_epoch;
+};
+
+void TrackingNode::process (AudioSampleBuffer& buffer)
+{
+    const ScopedSnapshotReader reader (m_readerEpoch);
+    const Array<TrackingModule*>& modules = m_moduleSnapshot.load()->modules;
+
+    const int64 now = CoreServices::getSoftwareTimestamp();
+    const int64 blockStart = CoreServices::getGlobalTimestamp();
+    const int nSamples = jmax (buffer.getNumSamples(), 1);
+    // The last sample of the block was acquired just before this call
+    m_clock.addCalibrationPoint (now, blockStart + nSamples);
+
+    // Events are stamped on the sample clock, relative to the start of this block
+    setTimestampAndSamples (uint64 (blockStart), nSamples);
+
+    if (m_statisticsChannel != nullptr && m_statisticsReady.load (std::memory_order_acquire))
+    {
+        for (int i = 0; i < m_statisticsText.size(); i++)
+        {
+            TextEventPtr event = TextEvent::createTextEvent (m_statisticsChannel, blockStart, m_statisticsText[i]);
+            addEvent (m_statisticsChannel, event, 0);
+        }
+        m_statisticsReady.store (false, std::memory_order_release);
+    }
+
+    // Messages wait in their queues until the software to sample clock mapping
+    // exists, so that every event of a recording is on the sample clock
+    if (m_clock.softwareToSampleTimestamp (now) < 0)
+    {
+        return;
+    }
+
+    // No lock here: each queue is a lock-free SPSC ring, so the audio thread never
+    // waits on a receive thread.
+    // The messages of all sources are gathered first, so that they are emitted in
+    // time order; m_pendingEvents keeps its capacity from block to block.
+    m_pendingEvents.clear();
+    m_pendingKeypoints.clear();
+    PendingEvent pending;
+    TrackingData popped;
+    TrackingKeypoint poppedKeypoints[MAX_KEYPOINTS];
+    TrackingKeypoint latestKeypoints[MAX_KEYPOINTS];
+    const int nChannels = m_frameChannel != nullptr ? jmin (modules.size (), MAX_SOURCES)
+                                                    : jmin (modules.size (), moduleEventChannels.size ());
+    for (int i = 0; i < nChannels; i++)
+    {
+        auto *module = modules.getUnchecked (i);
+
+        if (module->m_sharedRing != nullptr)
+            pollSharedRing (module);
+
+        // Only the sources whose epoch moved have new messages. The epoch is read
+        // before the queue is drained, so a message pushed meanwhile moves it again
+        // and is picked up by the next block.
+        const uint64 epoch = module->m_epoch.load (std::memory_order_acquire);
+        if (epoch == module->m_drainedEpoch)
+            continue;
+
+        // Coalescing trades recording fidelity for control latency: messages older
+        // than the max age are discarded, and latest-only sources only emit the
+        // freshest of the remaining ones.
+        const bool latestOnly = module->m_latestOnly;
+        const int64 maxAge = Time::getHighResolutionTicksPerSecond() * module->m_maxAgeMs / 1000;
+        bool hasLatest = false;
+
+        // Frame events only carry the positions
+        TrackingKeypoint* keypoints = m_frameChannel == nullptr ? poppedKeypoints : nullptr;
+
+        // Whatever does not fit in the pending events stays queued for the next
+        // block, and the epoch is left as it is so that it is drained then
+        bool drained = true;
+        pending.module = i;
+        while (true)
+        {
+            if (! (latestOnly && hasLatest) && ! hasPendingRoom (i))
+            {
+                drained = false;
+                break;
+            }
+            if (! module->m_messageQueue.load()->pop (popped, keypoints))
+                break;
+
+            if (maxAge > 0 && now - int64 (popped.timestamp) > maxAge)
+            {
+                module->m_expired.fetch_add (1, std::memory_order_relaxed);
+                continue;
+            }
+            if (latestOnly)
+            {
+                if (hasLatest)
+                    module->m_coalesced.fetch_add (1, std::memory_order_relaxed);
+                pending.message = popped;
+                if (keypoints != nullptr)
+                    std::copy (keypoints, keypoints + popped.numKeypoints, latestKeypoints);
+                hasLatest = true;
+                continue;
+            }
+            pending.message = popped;
+            addPendingEvent (module, pending, keypoints, now, blockStart, nSamples);
+        }
+        if (hasLatest)
+            addPendingEvent (module, pending, latestKeypoints, now, blockStart, nSamples);
+        if (drained)
+            module->m_drainedEpoch = epoch;
+    }
+
+    std::sort (m_pendingEvents.begin(), m_pendingEvents.end(),
+               [] (const PendingEvent& a, const PendingEvent& b)
+               {
+                   if (a.message.timestamp != b.message.timestamp)
+                       return a.message.timestamp < b.message.timestamp;
+                   return a.sequence < b.sequence;
+               });
+
+    if (m_frameChannel != nullptr)
+    {
+        emitFrameEvents (blockStart);
+        return;
+    }
+
+    for (const PendingEvent& entry : m_pendingEvents)
+    {
+        auto *module = modules.getUnchecked (entry.module);
+        const EventChannel* chan = moduleEventChannels.getUnchecked (entry.module);
+        const TrackingData& message = entry.message;
+        TrackingModule::EventMetadata* metadata = module->m_metadata.load (std::memory_order_acquire);
+
+        metadata->captureTime->setValue(message.hasFrameInfo ? message.captureTime : int64(0));
+        metadata->frame->setValue(message.hasFrameInfo ? message.frame : int32(-1));
+        // The position, then the keypoints the channel declares; missing ones have
+        // no confidence
+        const int numKeypoints = moduleChannelKeypoints.getUnchecked (entry.module);
+        uint8 payload[sizeof(TrackingPosition) + MAX_KEYPOINTS * sizeof(TrackingKeypoint)];
+        std::memcpy (payload, &message.position, sizeof(TrackingPosition));
+        TrackingKeypoint* keypoints = reinterpret_cast<TrackingKeypoint*> (payload + sizeof(TrackingPosition));
+        for (int k = 0; k < numKeypoints; k++)
+        {
+            if (k < message.numKeypoints)
+            {
+                keypoints[k] = m_pendingKeypoints[size_t (entry.keypointIndex + k)];
+            }
+            else
+            {
+                keypoints[k].x = keypoints[k].y = std::numeric_limits<float>::quiet_NaN();
+                keypoints[k].confidence = 0;
+            }
+        }
+
+        // addEvent serializes the event right away, so the metadata values can be
+        // overwritten for the next one
+        BinaryEventPtr event = BinaryEvent::createBinaryEvent (chan,
+                                                               blockStart + entry.sampleOffset,
+                                                               payload,
+                                                               sizeof(TrackingPosition) + numKeypoints * sizeof(TrackingKeypoint),
+                                                               metadata->values);
+        addEvent (chan, event, entry.sampleOffset);
+    }
+
+}
+
+bool TrackingNode::hasPendingRoom (int module) const
+{
+    const int numKeypoints = module < moduleChannelKeypoints.size() ? moduleChannelKeypoints.getUnchecked (module) : 0;
+    return m_pendingEvents.size() < m_pendingEvents.capacity()
+        && m_pendingKeypoints.size() + size_t (numKeypoints) <= m_pendingKeypoints.capacity();
+}
+
+void TrackingNode::addPendingEvent (TrackingModule* module, PendingEvent& pending, const TrackingKeypoint* keypoints,
+                                    int64 now, int64 blockStart, int nSamples)
+{
+    module->m_statistics.addEmitted (pending.message.timestamp, now);
+
+    // The messages popped here were received while the samples of this block
+    // were acquired, so each one is placed at the sample it arrived at, with no
+    // added delay. Older messages (a stalled audio thread) are all placed at
+    // offset 0, and messages received after the block ended at its last sample.
+    const int64 sampleTime = m_clock.softwareToSampleTimestamp (pending.message.timestamp);
+    pending.sampleOffset = int (jlimit (int64 (0), int64 (nSamples - 1), sampleTime - blockStart));
+    pending.sequence = m_pendingEvents.size();
+
+    // Only the keypoints the event channel declares are kept
+    if (keypoints == nullptr || pending.module >= moduleChannelKeypoints.size())
+        pending.message.numKeypoints = 0;
+    else
+        pending.message.numKeypoints = jmin (pending.message.numKeypoints,
+                                             moduleChannelKeypoints.getUnchecked (pending.module));
+    pending.keypointIndex = int (m_pendingKeypoints.size());
+    m_pendingKeypoints.insert (m_pendingKeypoints.end(), keypoints, keypoints + pending.message.numKeypoints);
+
+    m_pendingEvents.push_back (pending);
+}
+
+void TrackingNode::pollSharedRing (TrackingModule* module)
+{
+    // Both ends of the queue are on the audio thread here, so it is only filled up
+    // to its capacity: the rest stays in the ring until the next block.
+    TrackingQueue* queue = module->m_messageQueue;
+    tracking_shm_record record;
+    TrackingData message;
+    while (queue->getSize() < queue->getCapacity() && module->m_sharedRing->read (record))
+    {
+        message.timestamp = TrackingClock::receiveTimeToSoftwareTimestamp (record.writeTimeNs);
+        message.position.x = record.x;
+        message.position.y = record.y;
+        message.position.width = record.width;
+        message.position.height = record.height;
+        message.hasFrameInfo = (record.flags & TRACKING_SHM_FRAME_INFO) != 0;
+        message.captureTime = message.hasFrameInfo ? record.captureTime : 0;
+        message.frame = message.hasFrameInfo ? record.frame : 0;
+        message.numKeypoints = 0;
+
+        module->m_statistics.addReceived (message.timestamp);
+        if (message.hasFrameInfo)
+            module->countFrame (message.frame);
+
+        queue->push (message);
+        module->m_epoch.fetch_add (1, std::memory_order_release);
+    }
+}
+
+static bool isSameFrame (const TrackingData& a, const TrackingData& b)
+{
+    if (a.hasFrameInfo && b.hasFrameInfo)
+        return a.frame == b.frame;
+    if (!a.hasFrameInfo && !b.hasFrameInfo)
+        return a.timestamp == b.timestamp;
+    return false;
+}
+
+void TrackingNode::emitFrameEvents (int64 blockStart)
+{
+    TrackingFrame frame;
+    int frameOffset = 0;
+    const TrackingData* first = nullptr;
+
+    for (size_t i = 0; i <= m_pendingEvents.size(); i++)
+    {
+        const PendingEvent* entry = i < m_pendingEvents.size() ? &m_pendingEvents[i] : nullptr;
+
+        // A frame ends with the next frame, or when one of its sources repeats
+        if (first != nullptr
+            && (entry == nullptr || !isSameFrame (*first, entry->message)
+                || (frame.validMask & (1u << entry->module)) != 0))
+        {
+            BinaryEventPtr event = BinaryEvent::createBinaryEvent (m_frameChannel,
+                                                                   blockStart + frameOffset,
+                                                                   &frame,
+                                                                   sizeof(TrackingFrame));
+            addEvent (m_frameChannel, event, frameOffset);
+            first = nullptr;
+        }
+
+        if (entry == nullptr)
+            break;
+
+        if (first == nullptr)
+        {
+            first = &entry->message;
+            frameOffset = entry->sampleOffset;
+            zerostruct (frame);
+            frame.frame = -1;
+        }
+
+        const TrackingData& message = entry->message;
+        frame.validMask |= 1u << entry->module;
+        frame.positions[entry->module] = message.position;
+        if (message.hasFrameInfo)
+        {
+            frame.frame = message.frame;
+            frame.captureTime = message.captureTime;
+        }
+    }
+}
+
+int TrackingNode::getTrackingModuleIndex(int port, const String& address)
+{
+    int index = -1;
+    for (int i = 0; i < trackingModules.size (); i++)
+    {
+        auto *current  = trackingModules.getReference(i);
+        if (current->m_port == port && current->m_address.compare(address) == 0)
+            index = i;
+    }
+    return index;
+}
+
+int TrackingNode::getNSources()
+{
+    return trackingModules.size ();
+}
+
+static uint64 routingKey (int port, int addressId)
+{
+    return (uint64 (uint32 (port)) << 32) | uint32 (addressId);
+}
+
+int TrackingNode::internAddress (const String& address)
+{
+    // Ids are never reused, so a route always resolves to the address it was built for
+    m_internedAddresses.addIfNotAlreadyThere (address);
+    return m_internedAddresses.indexOf (address);
+}
+
+void TrackingNode::updateRoutingTable()
+{
+    std::unordered_map<uint64, TrackingModule*> table;
+    for (int i = 0; i < trackingModules.size(); i++)
+    {
+        auto *module = trackingModules.getReference (i);
+        if (module->m_server != nullptr)
+            table[routingKey (module->m_port, internAddress (module->m_address))] = module;
+    }
+
+    const ScopedLock sl (lock);
+    m_routingTable.swap (table);
+}
+
+void TrackingNode::deleteModules (Array<TrackingModule*> modules)
+{
+    for (int i = 0; i < modules.size(); i++)
+        trackingModules.removeFirstMatchingValue (modules.getUnchecked (i));
+
+    updateRoutingTable();
+
+    // Unbound right away, so their ports and addresses can be reused, but process()
+    // may still be draining them
+    for (int i = 0; i < modules.size(); i++)
+        modules.getUnchecked (i)->unbind();
+
+    publishModules (modules);
+}
+
+void TrackingNode::replaceQueue (TrackingModule* module, TrackingQueue* queue)
+{
+    TrackingQueue* replaced;
+    {
+        // The receive thread only pushes with the lock held
+        const ScopedLock sl (lock);
+        replaced = module->m_messageQueue.exchange (queue);
+    }
+    // process() may still be draining the old queue
+    publishModules (Array<TrackingModule*>(), replaced);
+}
+
+void TrackingNode::replaceMetadata (TrackingModule* module)
+{
+    // process() may still be emitting with the old metadata
+    publishModules (Array<TrackingModule*>(), nullptr, module->m_metadata.exchange (module->buildMetadata()));
+}
+
+void TrackingNode::publishModules (const Array<TrackingModule*>& removed, TrackingQueue* replacedQueue,
+                                   TrackingModule::EventMetadata* replacedMetadata)
+{
+    ModuleSnapshot* snapshot = new ModuleSnapshot();
+    snapshot->modules = trackingModules;
+
+    RetiredModules retired;
+    retired.snapshot = m_moduleSnapshot.exchange (snapshot);
+    retired.modules = removed;
+    retired.queue = replacedQueue;
+    retired.metadata = replacedMetadata;
+    // Read after the exchange: a process() call starting later gets the new snapshot
+    retired.readerEpoch = m_readerEpoch.load();
+    m_retired.push_back (retired);
+
+    reclaimRetired (false);
+}
+
+void TrackingNode::reclaimRetired (bool force)
+{
+    const uint64 epoch = m_readerEpoch.load();
+    for (auto it = m_retired.begin(); it != m_retired.end();)
+    {
+        if (force || it->readerEpoch % 2 == 0 || it->readerEpoch != epoch)
+        {
+            delete it->snapshot;
+            for (int i = 0; i < it->modules.size(); i++)
+                delete it->modules.getUnchecked (i);
+            delete it->queue;
+            delete it->metadata;
+            it = m_retired.erase (it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void TrackingNode::receiveMalformed (int port, int addressId)
+{
+    const ScopedLock sl (lock);
+
+    auto entry = m_routingTable.find (routingKey (port, addressId));
+    if (entry != m_routingTable.end())
+        entry->second->m_statistics.addMalformed();
+}
+
+void TrackingNode::receiveMessage (int port, int addressId, const TrackingData &message,
+                                   const TrackingKeypoint* keypoints)
+{
+    const ScopedLock sl (lock);
+
+    auto entry = m_routingTable.find (routingKey (port, addressId));
+    if (entry != m_routingTable.end())
+    {
+        auto *selectedModule = entry->second;
+
+        selectedModule->m_statistics.addReceived (message.timestamp);
+
+        if (CoreServices::getRecordingStatus())
+        {
+            if (!m_isRecordingTimeLogged)
+            {
+                m_received_msg = 0;
+                m_startingRecTimeMillis =  Time::currentTimeMillis();
+                m_isRecordingTimeLogged = true;
+                std::cout << "Starting Recording Ts: " << m_startingRecTimeMillis << std::endl;
+                selectedModule->m_messageQueue.load()->clear();
+                CoreServices::sendStatusMessage ("Clearing queue before start recording");
+            }
+        }
+        else
+        {
+            m_isRecordingTimeLogged = false;
+        }
+
+
+        if (CoreServices::getAcquisitionStatus()) // && !CoreServices::getRecordingStatus())
+        {
+            if (!m_isAcquisitionTimeLogged)
+            {
+                m_startingAcqTimeMillis = Time::currentTimeMillis();
+                m_isAcquisitionTimeLogged = true;
+                std::cout << "Starting Acquisition at Ts: " << m_startingAcqTimeMillis << std::endl;
+                CoreServices::sendStatusMessage ("Clearing queue before start acquisition");
+            }
+            if (selectedModule->m_clearPending.exchange (false))
+                selectedModule->m_messageQueue.load()->clear();
+
+            if (message.hasFrameInfo)
+                selectedModule->countFrame (message.frame);
+
+            // The server stamps every message of a packet with its receive time.
+            // The epoch moves after the push, so process() sees the message once it
+            // sees the new epoch.
+            selectedModule->m_messageQueue.load()->push (message, keypoints);
+            selectedModule->m_epoch.fetch_add (1, std::memory_order_release);
+            m_received_msg++;
+        }
+        else
+            m_isAcquisitionTimeLogged = false;
+    }
+}
+
+TrackingServer* TrackingNode::acquireServer (int port, const String& address)
+{
+    TrackingServer* server = nullptr;
+    for (int i = 0; i < m_servers.size(); i++)
+    {
+        if (m_servers.getUnchecked (i)->getPort() == port)
+            server = m_servers.getUnchecked (i);
+    }
+
+    const bool created = server == nullptr;
+    if (created)
+    {
+        server = new TrackingServer (port, m_receiveSettings, this);
+    }
+    else
+    {
+        // Routes are not touched while a packet is being dispatched
+        m_receiver->detach (server);
+    }
+
+    // A new server is only kept once it is attached, so that a failed attach
+    // leaves no route and no server behind for the next source on the port
+    server->addAddress (address, internAddress (address));
+    try
+    {
+        m_receiver->attach (server);
+    }
+    catch (const std::runtime_error&)
+    {
+        server->removeAddress (address);
+        if (created)
+            delete server;
+        else
+            m_receiver->attach (server);
+        throw;
+    }
+
+    if (created)
+        m_servers.add (server);
+    return server;
+}
+
+void TrackingNode::releaseServer (TrackingServer* server, const String& address)
+{
+    // Detaching only waits for a packet being dispatched, never for a thread.
+    m_receiver->detach (server);
+    server->removeAddress (address);
+
+    if (server->hasAddresses())
+    {
+        m_receiver->attach (server);
+    }
+    else
+    {
+        m_servers.removeFirstMatchingValue (server);
+        delete server;
+    }
+}
+
+bool TrackingNode::isReady()
+{
+    return true;
+}
+
+void TrackingNode::saveCustomParametersToXml (XmlElement* parentElement)
+{
+    XmlElement* mainNode = parentElement->createNewChildElement ("TrackingNode");
+    mainNode->setAttribute ("interface", m_receiveSettings.interfaceAddress);
+    mainNode->setAttribute ("receive_buffer", m_receiveSettings.receiveBufferSize);
+    mainNode->setAttribute ("busy_poll", m_receiveSettings.busyPollMicros);
+    mainNode->setAttribute ("thread_priority", m_receiveSettings.threadPriority);
+    mainNode->setAttribute ("cpu", m_receiveSettings.cpu);
+    mainNode->setAttribute ("frame_channel", m_frameChannelMode);
+    for (int i = 0; i < trackingModules.size(); i++)
+    {
+        auto *module = trackingModules.getReference (i);
+        XmlElement* source = new XmlElement("Source_"+String(i+1));
+        source->setAttribute ("port", module->m_port);
+        source->setAttribute ("address", module->m_address);
+        source->setAttribute ("color", module->m_color);
+        source->setAttribute ("queue_size", module->m_messageQueue.load()->getCapacity());
+        source->setAttribute ("overflow", module->m_messageQueue.load()->getOverflowPolicy());
+        source->setAttribute ("transport", module->m_transport);
+        source->setAttribute ("keypoints", module->m_keypoints);
+        source->setAttribute ("keypoint_names", module->m_keypointNames);
+        source->setAttribute ("latest_only", module->m_latestOnly.load());
+        source->setAttribute ("max_age_ms", module->m_maxAgeMs.load());
+        mainNode->addChildElement(source);
     }
 }
 
 void TrackingNode::loadCustomParametersFromXml ()
 {
-    trackingModules.clear();
-    if (parametersAsXml == nullptr)
+    deleteModules (trackingModules);
+    if (parametersAsXml == nullptr)
+    {
+        return;
+    }
+
+    forEachXmlChildElement (*parametersAsXml, mainNode)
+    {
+        if (mainNode->hasTagName ("TrackingNode"))
+        {
+            // Before the sources, so that they bind with these settings
+            TrackingReceiveSettings settings;
+            settings.interfaceAddress = mainNode->getStringAttribute ("interface", DEF_INTERFACE);
+            settings.receiveBufferSize = mainNode->getIntAttribute ("receive_buffer", 0);
+            settings.busyPollMicros = mainNode->getIntAttribute ("busy_poll", 0);
+            settings.threadPriority = mainNode->getIntAttribute ("thread_priority", DEF_THREAD_PRIORITY);
+            settings.cpu = mainNode->getIntAttribute ("cpu", -1);
+            setReceiveSettings (settings);
+            m_frameChannelMode = mainNode->getBoolAttribute ("frame_channel", false);
+
+            forEachXmlChildElement(*mainNode, source)
+            {
+                int port = source->getIntAttribute("port");
+                String address = source->getStringAttribute("address");
+                String color = source->getStringAttribute("color");
+                int queueSize = source->getIntAttribute("queue_size", BUFFER_SIZE);
+                // Older settings may name the removed blocking policy (2), which
+                // always ended in dropping the new message once the wait expired
+                overflow_policy policy = source->getIntAttribute("overflow", overflow_drop_oldest) == overflow_drop_oldest
+                                             ? overflow_drop_oldest : overflow_drop_newest;
+                tracking_transport transport = (tracking_transport) source->getIntAttribute("transport", transport_udp);
+
+                addSource (port, address, color, queueSize, policy, transport);
+                setKeypoints (trackingModules.size() - 1, source->getIntAttribute("keypoints", 0));
+                setKeypointNames (trackingModules.size() - 1, source->getStringAttribute("keypoint_names", ""));
+                setLatestOnly (trackingModules.size() - 1, source->getBoolAttribute("latest_only", false));
+                setMaxAge (trackingModules.size() - 1, source->getIntAttribute("max_age_ms", 0));
+            }
+        }
+    }
+}
+
+// Class TrackingQueue methods
+static int roundUpToPowerOfTwo (int size)
+{
+    int capacity = MIN_BUFFER_SIZE;
+    while (capacity < size && capacity < MAX_BUFFER_SIZE)
+        capacity <<= 1;
+    return capacity;
+}
+
+TrackingQueue::TrackingQueue (int capacity, overflow_policy policy, int numKeypoints)
+    : m_buffer (roundUpToPowerOfTwo (capacity), true)
+    , m_mask (uint64 (roundUpToPowerOfTwo (capacity) - 1))
+    , m_numKeypoints (jlimit (0, MAX_KEYPOINTS, numKeypoints))
+    , m_head (0)
+    , m_tail (0)
+    , m_policy (policy)
+    , m_overruns (0)
+    , m_dropped (0)
+{
+    if (m_numKeypoints > 0)
+        m_keypoints.allocate (size_t (m_mask + 1) * size_t (m_numKeypoints), true);
+}
+
+TrackingQueue::~TrackingQueue() {}
+
+bool TrackingQueue::push (const TrackingData &message, const TrackingKeypoint* keypoints)
+{
+    const uint64 head = m_head.load (std::memory_order_relaxed);
+    uint64 tail = m_tail.load (std::memory_order_acquire);
+
+    if (head - tail > m_mask)
+    {
+        m_overruns.fetch_add (1, std::memory_order_relaxed);
+
+        switch (m_policy.load (std::memory_order_relaxed))
+        {
+        case overflow_drop_newest:
+            m_dropped.fetch_add (1, std::memory_order_relaxed);
+            return false;
+
+        case overflow_drop_oldest:
+        default:
+            // If the CAS fails the consumer has just popped that entry, which frees the
+            // slot just as well.
+            if (m_tail.compare_exchange_strong (tail, tail + 1, std::memory_order_acq_rel))
+                m_dropped.fetch_add (1, std::memory_order_relaxed);
+            break;
+        }
+    }
+
+    TrackingData& slot = m_buffer[head & m_mask];
+    slot = message;
+    slot.numKeypoints = keypoints != nullptr ? jlimit (0, m_numKeypoints, message.numKeypoints) : 0;
+    if (slot.numKeypoints > 0)
+        std::memcpy (m_keypoints + (head & m_mask) * m_numKeypoints, keypoints,
+                     size_t (slot.numKeypoints) * sizeof (TrackingKeypoint));
+
+    m_head.store (head + 1, std::memory_order_release);
+    return true;
+}
+
+bool TrackingQueue::pop (TrackingData &message, TrackingKeypoint* keypoints)
+{
+    uint64 tail = m_tail.load (std::memory_order_acquire);
+    while (true)
+    {
+        if (tail == m_head.load (std::memory_order_acquire))
+            return false;
+
+        message = m_buffer[tail & m_mask];
+        // Clamped again: a copy torn by the producer is only thrown away below
+        message.numKeypoints = jlimit (0, m_numKeypoints, message.numKeypoints);
+        if (keypoints != nullptr && message.numKeypoints > 0)
+            std::memcpy (keypoints, m_keypoints + (tail & m_mask) * m_numKeypoints,
+                         size_t (message.numKeypoints) * sizeof (TrackingKeypoint));
+
+        // The producer may have discarded this entry (drop-oldest) while we copied it;
+        // in that case the CAS fails, tail is reloaded and the copy is thrown away.
+        if (m_tail.compare_exchange_weak (tail, tail + 1, std::memory_order_acq_rel,
+                                          std::memory_order_acquire))
+            return true;
+    }
+}
+
+bool TrackingQueue::isEmpty() const
+{
+    return m_head.load (std::memory_order_acquire) == m_tail.load (std::memory_order_acquire);
+}
+
+void TrackingQueue::clear()
+{
+    const uint64 head = m_head.load (std::memory_order_relaxed);
+    uint64 tail = m_tail.load (std::memory_order_acquire);
+    while (tail != head
+           && !m_tail.compare_exchange_weak (tail, head, std::memory_order_acq_rel,
+                                             std::memory_order_acquire))
+    {
+    }
+}
+
+int TrackingQueue::getCapacity() const
+{
+    return int (m_mask + 1);
+}
+
+int TrackingQueue::getNumKeypoints() const
+{
+    return m_numKeypoints;
+}
+
+int TrackingQueue::getSize() const
+{
+    const uint64 tail = m_tail.load (std::memory_order_acquire);
+    return int (m_head.load (std::memory_order_acquire) - tail);
+}
+
+overflow_policy TrackingQueue::getOverflowPolicy() const
+{
+    return (overflow_policy) m_policy.load (std::memory_order_relaxed);
+}
+
+void TrackingQueue::setOverflowPolicy (overflow_policy policy)
+{
+    m_policy.store (policy, std::memory_order_relaxed);
+}
+
+uint64 TrackingQueue::getOverrunCount() const
+{
+    return m_overruns.load (std::memory_order_relaxed);
+}
+
+uint64 TrackingQueue::getDroppedCount() const
+{
+    return m_dropped.load (std::memory_order_relaxed);
+}
+
+// Class TrackingSharedRing methods
+String TrackingSharedRing::getObjectName (const String& address)
+{
+    return TRACKING_SHM_PREFIX + address.replaceCharacter ('/', '_');
+}
+
+TrackingSharedRing::TrackingSharedRing (const String& address)
+    : m_name (getObjectName (address))
+    , m_header (nullptr)
+    , m_size (sizeof (tracking_shm_header) + TRACKING_SHM_CAPACITY * sizeof (tracking_shm_record))
+    , m_readIndex (0)
+    , m_dropped (0)
+{
+#if JUCE_WINDOWS
+    throw std::runtime_error ("the shared memory transport is not available on Windows");
+#else
+    // Owner only: any other local user could otherwise inject positions
+    const int fd = shm_open (m_name.toRawUTF8(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+    {
+        throw std::runtime_error ("cannot open " + m_name.toStdString() + ": " + strerror (errno));
+    }
+
+    struct stat info;
+    const bool resized = fstat (fd, &info) != 0 || size_t (info.st_size) != m_size;
+    if (resized && ftruncate (fd, off_t (m_size)) != 0)
+    {
+        const int error = errno;
+        close (fd);
+        throw std::runtime_error ("cannot size " + m_name.toStdString() + ": " + strerror (error));
+    }
+
+    void* memory = mmap (nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int error = errno;
+    close (fd);
+    if (memory == MAP_FAILED)
+    {
+        throw std::runtime_error ("cannot map " + m_name.toStdString() + ": " + strerror (error));
+    }
+    m_header = static_cast<tracking_shm_header*> (memory);
+
+    if (resized
+        || m_header->magic != TRACKING_SHM_MAGIC
+        || m_header->version != TRACKING_SHM_VERSION
+        || m_header->capacity != TRACKING_SHM_CAPACITY
+        || m_header->recordSize != sizeof (tracking_shm_record))
+    {
+        memset (memory, 0, m_size);
+        m_header->version = TRACKING_SHM_VERSION;
+        m_header->capacity = TRACKING_SHM_CAPACITY;
+        m_header->recordSize = sizeof (tracking_shm_record);
+        // Last, so that a tracker checking the magic sees a complete header
+        __atomic_store_n (&m_header->magic, TRACKING_SHM_MAGIC, __ATOMIC_RELEASE);
+    }
+
+    // Records written while nobody was reading are stale
+    skipToLatest();
+#endif
+}
+
+TrackingSharedRing::~TrackingSharedRing()
+{
+#if ! JUCE_WINDOWS
+    if (m_header != nullptr)
+        munmap (m_header, m_size);
+#endif
+}
+
+bool TrackingSharedRing::read (tracking_shm_record& record)
+{
+#if JUCE_WINDOWS
+    return false;
+#else
+    // Not m_header->capacity: the header lives in memory the tracker can write, and
+    // the mapping is only ever TRACKING_SHM_CAPACITY records long
+    const uint64 capacity = TRACKING_SHM_CAPACITY;
+    const tracking_shm_record* records = tracking_shm_records (m_header);
+
+    for (;;)
+    {
+        const uint64 written = __atomic_load_n (&m_header->writeIndex, __ATOMIC_ACQUIRE);
+        if (m_readIndex > written)
+        {
+            // The tracker started over on a reinitialized ring
+            m_readIndex = written;
+        }
+        if (m_readIndex == written)
+        {
+            return false;
+        }
+        if (written - m_readIndex > capacity)
+        {
+            m_dropped.fetch_add (written - capacity - m_readIndex, std::memory_order_relaxed);
+            m_readIndex = written - capacity;
+        }
+
+        // Seqlock read: the copy is only kept if the slot still holds the same
+        // complete record afterwards
+        const tracking_shm_record* slot = records + (m_readIndex & (capacity - 1));
+        const uint64 expected = 2 * m_readIndex + 2;
+        if (__atomic_load_n (&slot->sequence, __ATOMIC_ACQUIRE) == expected)
+        {
+            record = *slot;
+            __atomic_thread_fence (__ATOMIC_ACQUIRE);
+            if (__atomic_load_n (&slot->sequence, __ATOMIC_RELAXED) == expected)
+            {
+                m_readIndex++;
+                return true;
+            }
+        }
+
+        // Overwritten by the tracker before it could be read
+        m_dropped.fetch_add (1, std::memory_order_relaxed);
+        m_readIndex++;
+    }
+#endif
+}
+
+void TrackingSharedRing::skipToLatest()
+{
+#if ! JUCE_WINDOWS
+    m_readIndex = __atomic_load_n (&m_header->writeIndex, __ATOMIC_ACQUIRE);
+#endif
+}
+
+uint64 TrackingSharedRing::getDroppedCount() const
+{
+    return m_dropped.load (std::memory_order_relaxed);
+}
+
+const String& TrackingSharedRing::getName() const
+{
+    return m_name;
+}
+
+// Class TrackingStatistics methods
+TrackingStatistics::TrackingStatistics()
+{
+    reset();
+}
+
+void TrackingStatistics::reset()
+{
+    m_received = 0;
+    m_malformed = 0;
+    m_emitted = 0;
+    for (int i = 0; i < STATS_HISTOGRAM_BINS; i++)
     {
-        return;
+        m_interArrival[i] = 0;
+        m_latency[i] = 0;
     }
+    m_meanInterval = 0;
+    m_jitter = 0;
+    m_lastReceive = 0;
+    m_lastInterval = -1;
+}
 
-    forEachXmlChildElement (*parametersAsXml, mainNode)
+double TrackingStatistics::ticksToMicros (int64 ticks)
+{
+    return double (ticks) * 1e6 / double (Time::getHighResolutionTicksPerSecond());
+}
+
+int TrackingStatistics::getBin (double micros)
+{
+    int bin = 0;
+    while (bin < STATS_HISTOGRAM_BINS - 1 && micros >= getBinLimit (bin))
+        bin++;
+    return bin;
+}
+
+double TrackingStatistics::getBinLimit (int bin)
+{
+    return double (int64 (1) << bin);
+}
+
+double TrackingStatistics::getPercentile (const uint64* bins, double fraction)
+{
+    uint64 total = 0;
+    for (int i = 0; i < STATS_HISTOGRAM_BINS; i++)
+        total += bins[i];
+    if (total == 0)
     {
-        if (mainNode->hasTagName ("TrackingNode"))
-        {
-            forEachXmlChildElement(*mainNode, source)
-            {
-                int port = source->getIntAttribute("port");
-                String address = source->getStringAttribute("address");
-                String color = source->getStringAttribute("color");
+        return 0;
+    }
 
-                addSource (port, address, color);
-            }
+    uint64 count = 0;
+    for (int i = 0; i < STATS_HISTOGRAM_BINS; i++)
+    {
+        count += bins[i];
+        if (double (count) >= fraction * double (total))
+            return getBinLimit (i);
+    }
+    return getBinLimit (STATS_HISTOGRAM_BINS - 1);
+}
+
+void TrackingStatistics::addReceived (int64 receiveTimestamp)
+{
+    m_received.fetch_add (1, std::memory_order_relaxed);
+
+    // Messages of one packet share their timestamp; only count packet arrivals
+    if (m_lastReceive != 0 && receiveTimestamp > m_lastReceive)
+    {
+        const double interval = ticksToMicros (receiveTimestamp - m_lastReceive);
+        m_interArrival[getBin (interval)].fetch_add (1, std::memory_order_relaxed);
+
+        // Exponential smoothing with a gain of 1/16, as for the RTP jitter
+        double mean = m_meanInterval.load (std::memory_order_relaxed);
+        mean = (mean == 0) ? interval : mean + (interval - mean) / 16.0;
+        m_meanInterval.store (mean, std::memory_order_relaxed);
+
+        if (m_lastInterval >= 0)
+        {
+            double jitter = m_jitter.load (std::memory_order_relaxed);
+            jitter += (std::abs (interval - m_lastInterval) - jitter) / 16.0;
+            m_jitter.store (jitter, std::memory_order_relaxed);
         }
+        m_lastInterval = interval;
     }
+    if (receiveTimestamp > m_lastReceive)
+        m_lastReceive = receiveTimestamp;
 }
 
-// Class TrackingQueue methods
-TrackingQueue::TrackingQueue()
-    : m_head (-1)
-    , m_tail (-1)
+void TrackingStatistics::addMalformed()
 {
-    memset (m_buffer, 0, BUFFER_SIZE);
+    m_malformed.fetch_add (1, std::memory_order_relaxed);
 }
 
-TrackingQueue::~TrackingQueue() {}
+void TrackingStatistics::addEmitted (int64 receiveTimestamp, int64 emitTimestamp)
+{
+    m_emitted.fetch_add (1, std::memory_order_relaxed);
+    const double latency = ticksToMicros (emitTimestamp - receiveTimestamp);
+    m_latency[getBin (latency < 0 ? 0 : latency)].fetch_add (1, std::memory_order_relaxed);
+}
 
-void TrackingQueue::push (const TrackingData &message)
+uint64 TrackingStatistics::getReceivedCount() const
 {
-    m_head = (m_head + 1) % BUFFER_SIZE;
-    m_buffer[m_head] = message;
+    return m_received.load (std::memory_order_relaxed);
 }
 
-TrackingData* TrackingQueue::pop ()
+uint64 TrackingStatistics::getMalformedCount() const
 {
-    if (isEmpty())
-        return nullptr;
+    return m_malformed.load (std::memory_order_relaxed);
+}
 
-    m_tail = (m_tail + 1) % BUFFER_SIZE;
-    return &(m_buffer[m_tail]);
+uint64 TrackingStatistics::getEmittedCount() const
+{
+    return m_emitted.load (std::memory_order_relaxed);
+}
 
+double TrackingStatistics::getRate() const
+{
+    const double mean = m_meanInterval.load (std::memory_order_relaxed);
+    return (mean > 0) ? 1e6 / mean : 0;
 }
 
-bool TrackingQueue::isEmpty()
+double TrackingStatistics::getJitter() const
 {
-    return m_head == m_tail;
+    return m_jitter.load (std::memory_order_relaxed);
 }
 
-void TrackingQueue::clear()
+void TrackingStatistics::getInterArrivalHistogram (uint64* bins) const
 {
-    m_tail = -1;
-    m_head = -1;
+    for (int i = 0; i < STATS_HISTOGRAM_BINS; i++)
+        bins[i] = m_interArrival[i].load (std::memory_order_relaxed);
 }
 
-// Class TrackingServer methods
-TrackingServer::TrackingServer ()
-    : Thread ("OscListener Thread")
-    , m_incomingPort (0)
-    , m_address ("")
+void TrackingStatistics::getLatencyHistogram (uint64* bins) const
 {
+    for (int i = 0; i < STATS_HISTOGRAM_BINS; i++)
+        bins[i] = m_latency[i].load (std::memory_order_relaxed);
 }
 
-TrackingServer::TrackingServer (int port, String address)
-    : Thread ("OscListener Thread")
-    , m_incomingPort (port)
-    , m_address (address)
+// Class TrackingClock methods
+TrackingClock::TrackingClock()
+{
+    reset();
+}
+
+int64 TrackingClock::receiveTimeToSoftwareTimestamp (long long receiveTimeNs)
+{
+    // NOTE: We cannot trust the getGlobalTimestamp function because it can return
+    // negative time deltas. The reason is unknown.
+    const int64 now = CoreServices::getSoftwareTimestamp();
+    if (receiveTimeNs <= 0)
+    {
+        return now;
+    }
+
+    // The kernel stamps datagrams with the wall clock
+    const long long wallClockNs = std::chrono::duration_cast<std::chrono::nanoseconds> (
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    const long long waitedNs = wallClockNs - receiveTimeNs;
+
+    // A wall clock step between the two readings makes the wait meaningless
+    if (waitedNs < 0 || waitedNs > (long long) MAX_RECEIVE_WAIT_MS * 1000000)
+    {
+        return now;
+    }
+
+    return now - int64 (double (waitedNs) * 1e-9 * double (Time::getHighResolutionTicksPerSecond()));
+}
+
+void TrackingClock::addCalibrationPoint (int64 softwareTimestamp, int64 sampleTimestamp)
+{
+    m_software[m_next] = softwareTimestamp;
+    m_samples[m_next] = sampleTimestamp;
+    m_next = (m_next + 1) % CLOCK_CALIBRATION_POINTS;
+    if (m_count < CLOCK_CALIBRATION_POINTS)
+        m_count++;
+
+    if (m_count < 2)
+    {
+        return;
+    }
+
+    // Least-squares line through the points, centered on their means to keep the
+    // sums small
+    const int64 softwareOrigin = m_software[0];
+    double meanSoftware = 0;
+    double meanSamples = 0;
+    for (int i = 0; i < m_count; i++)
+    {
+        meanSoftware += double (m_software[i] - softwareOrigin);
+        meanSamples += double (m_samples[i]);
+    }
+    meanSoftware /= m_count;
+    meanSamples /= m_count;
+
+    double covariance = 0;
+    double variance = 0;
+    for (int i = 0; i < m_count; i++)
+    {
+        const double dx = double (m_software[i] - softwareOrigin) - meanSoftware;
+        covariance += dx * (double (m_samples[i]) - meanSamples);
+        variance += dx * dx;
+    }
+
+    if (variance <= 0)
+    {
+        return;
+    }
+
+    m_slope = covariance / variance;
+    m_softwareOrigin = softwareOrigin + int64 (meanSoftware);
+    m_sampleOrigin = meanSamples + m_slope * (double (m_softwareOrigin - softwareOrigin) - meanSoftware);
+    m_isCalibrated = true;
+}
+
+int64 TrackingClock::softwareToSampleTimestamp (int64 softwareTimestamp) const
+{
+    if (!m_isCalibrated)
+    {
+        return -1;
+    }
+
+    return int64 (m_sampleOrigin + m_slope * double (softwareTimestamp - m_softwareOrigin) + 0.5);
+}
+
+void TrackingClock::reset()
+{
+    m_count = 0;
+    m_next = 0;
+    m_isCalibrated = false;
+    m_slope = 0;
+    m_softwareOrigin = 0;
+    m_sampleOrigin = 0;
+}
+
+// Class TrackingServer methods
+TrackingServer::TrackingServer (int port, const TrackingReceiveSettings& settings, TrackingNode* processor)
+    : m_incomingPort (port)
+    , m_processor (processor)
+    , m_packetTimestamp (0)
 {
+    // Bind synchronously, so that a busy port is reported to the caller right away
+    m_socket = new UdpReceiveSocket (IpEndpointName (settings.interfaceAddress.toRawUTF8(), m_incomingPort));
+    applySettings (settings);
+
+    if (!m_socket->SetReceiveTimestamps (true))
+        std::cout << "Kernel receive timestamps not available on port " << m_incomingPort << std::endl;
 }
 
 TrackingServer::~TrackingServer()
 {
-    cout << "Destructing tracking server" << endl;
-    // stop the OSC Listener thread running
-    //    m_listeningSocket->Break();
-    // allow the thread 2 seconds to stop cleanly - should be plenty of time.
-    cout << "Destructed tracking server" << endl;
-    delete m_listeningSocket;
+    delete m_socket;
+}
+
+UdpSocket* TrackingServer::getSocket()
+{
+    return m_socket;
+}
+
+int TrackingServer::getPort() const
+{
+    return m_incomingPort;
+}
+
+void TrackingServer::applySettings (const TrackingReceiveSettings& settings)
+{
+    if (settings.receiveBufferSize > 0)
+    {
+        // The system may cap the size (net.core.rmem_max on Linux); say so, since
+        // a full buffer drops frames without any other sign
+        int granted = m_socket->SetReceiveBufferSize (settings.receiveBufferSize);
+        if (granted < settings.receiveBufferSize)
+            std::cout << "Port " << m_incomingPort << ": receive buffer of " << settings.receiveBufferSize
+                      << " bytes requested, got " << granted << std::endl;
+    }
+
+    if (settings.busyPollMicros > 0 && !m_socket->SetBusyPoll (settings.busyPollMicros))
+        std::cout << "Port " << m_incomingPort << ": busy polling not available" << std::endl;
+}
+
+void TrackingServer::addAddress (const String& address, int addressId)
+{
+    m_routes.push_back (makeRoute (address, addressId));
+}
+
+TrackingServer::Route TrackingServer::makeRoute (const String& address, int addressId)
+{
+    Route route;
+    route.address = address;
+    route.addressId = addressId;
+    route.addressPattern = address.toStdString();
+
+    // Address pattern, null terminated and padded to 4 bytes
+    route.paddedAddress = route.addressPattern;
+    route.paddedAddress.append (4 - (route.addressPattern.size() % 4), '\0');
+    return route;
+}
+
+void TrackingServer::removeAddress (const String& address)
+{
+    for (auto it = m_routes.begin(); it != m_routes.end(); ++it)
+    {
+        if (it->address == address)
+        {
+            m_routes.erase (it);
+            return;
+        }
+    }
+}
+
+bool TrackingServer::hasAddresses() const
+{
+    return !m_routes.empty();
+}
+
+// Both type tag strings take 8 bytes once null terminated and padded
+static const char positionTypeTags[8] = { ',', 'f', 'f', 'f', 'f', '\0', '\0', '\0' };
+static const char extendedTypeTags[8] = { ',', 'f', 'f', 'f', 'f', 'h', 'i', '\0' };
+
+bool TrackingServer::decodeMessage (const Route& route, const char* data, int size, TrackingData& trackingData,
+                                    TrackingKeypoint* keypoints)
+{
+    const int addressSize = (int) route.paddedAddress.size();
+
+    if (size - addressSize < 12
+        || std::memcmp (data, route.paddedAddress.data(), addressSize) != 0)
+    {
+        return false;
+    }
+
+    const char* typeTags = data + addressSize;
+
+    // Keypoint message: ",i" then 3 floats per keypoint
+    if (typeTags[0] == ',' && typeTags[1] == 'i')
+    {
+        const int maxTags = size - addressSize;
+        int nFloats = 0;
+        while (2 + nFloats < maxTags && typeTags[2 + nFloats] == 'f')
+            nFloats++;
+        const int typeTagsSize = (2 + nFloats + 1 + 3) & ~3;
+        const int numKeypoints = nFloats / 3;
+        if (2 + nFloats >= maxTags || typeTags[2 + nFloats] != '\0'
+            || nFloats % 3 != 0 || numKeypoints > MAX_KEYPOINTS
+            || size - addressSize - typeTagsSize != 4 + 4 * nFloats)
+        {
+            return false;
+        }
+
+        const char* arguments = typeTags + typeTagsSize;
+        if ((int32) ByteOrder::bigEndianInt (arguments) != numKeypoints)
+        {
+            return false;
+        }
+
+        trackingData.hasFrameInfo = false;
+        trackingData.captureTime = 0;
+        trackingData.frame = 0;
+        trackingData.numKeypoints = numKeypoints;
+        static_assert (sizeof (TrackingKeypoint) == 3 * sizeof (uint32), "TrackingKeypoint must hold 3 floats");
+        for (int i = 0; i < nFloats; i++)
+        {
+            const uint32 value = ByteOrder::bigEndianInt (arguments + 4 + 4 * i);
+            std::memcpy (reinterpret_cast<char*> (keypoints) + 4 * i, &value, 4);
+        }
+        trackingData.position = getKeypointCentroid (keypoints, numKeypoints);
+        return true;
+    }
+
+    const int argumentsSize = size - addressSize - 8;
+    const char* arguments = typeTags + 8;
+
+    // OSC numbers are big-endian; floats are IEEE 754
+    if (argumentsSize == 16 && std::memcmp (typeTags, positionTypeTags, 8) == 0)
+    {
+        trackingData.hasFrameInfo = false;
+        trackingData.captureTime = 0;
+        trackingData.frame = 0;
+    }
+    else if (argumentsSize == 28 && std::memcmp (typeTags, extendedTypeTags, 8) == 0)
+    {
+        trackingData.hasFrameInfo = true;
+        trackingData.captureTime = (int64) ByteOrder::bigEndianInt64 (arguments + 16);
+        trackingData.frame = (int32) ByteOrder::bigEndianInt (arguments + 24);
+    }
+    else
+    {
+        return false;
+    }
+    trackingData.numKeypoints = 0;
+
+    uint32 values[4];
+    for (int i = 0; i < 4; i++)
+        values[i] = ByteOrder::bigEndianInt (arguments + 4 * i);
+
+    static_assert (sizeof (TrackingPosition) == sizeof (values), "TrackingPosition must hold 4 floats");
+    std::memcpy (&trackingData.position, values, sizeof (values));
+    return true;
+}
+
+void TrackingServer::ProcessPacket (const char* data, int size, const IpEndpointName& remoteEndpoint)
+{
+    m_packetTimestamp = CoreServices::getSoftwareTimestamp();
+
+    processElement (data, size, remoteEndpoint);
+}
+
+void TrackingServer::ProcessPacketBatch (const char* const* data, const int* sizes, const IpEndpointName* remoteEndpoints,
+                                         const long long* receiveTimesNs, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        m_packetTimestamp = TrackingClock::receiveTimeToSoftwareTimestamp (receiveTimesNs[i]);
+        processElement (data[i], sizes[i], remoteEndpoints[i]);
+    }
+}
+
+void TrackingServer::processElement (const char* data, int size, const IpEndpointName& remoteEndpoint)
+{
+    // Bundle: "#bundle\0", an 8 byte time tag, then elements each prefixed by
+    // their big-endian int32 size. The time tag is ignored, like oscpack does.
+    if (size >= 16 && std::memcmp (data, "#bundle\0", 8) == 0)
+    {
+        const char* element = data + 16;
+        const char* end = data + size;
+        while (end - element >= 4)
+        {
+            int32 elementSize = (int32) ByteOrder::bigEndianInt (element);
+            element += 4;
+            if (elementSize < 0 || elementSize > end - element || (elementSize & 0x03) != 0)
+            {
+                DBG ("error while parsing bundle: invalid element size\n");
+                return;
+            }
+            processElement (element, elementSize, remoteEndpoint);
+            element += elementSize;
+        }
+        return;
+    }
+
+    TrackingData trackingData;
+    TrackingKeypoint keypoints[MAX_KEYPOINTS];
+    trackingData.timestamp = m_packetTimestamp;
+
+    for (const Route& route : m_routes)
+    {
+        if (decodeMessage (route, data, size, trackingData, keypoints))
+        {
+            m_processor->receiveMessage (m_incomingPort, route.addressId, trackingData, keypoints);
+            return;
+        }
+    }
+
+    // Anything else (unknown addresses, wrong arguments) takes the slow path,
+    // which reports what is wrong with the message
+    try
+    {
+        osc::OscPacketListener::ProcessPacket (data, size, remoteEndpoint);
+    }
+    catch ( osc::Exception& e )
+    {
+        DBG ("error while parsing packet: " << e.what() << "\n");
+    }
 }
 
 void TrackingServer::ProcessMessage (const osc::ReceivedMessage& receivedMessage,
                                      const IpEndpointName&)
 {
-    int64 ts = CoreServices::getGlobalTimestamp();
+    const Route* route = nullptr;
     try
     {
-        uint32 argumentCount = 4;
+        for (const Route& r : m_routes)
+        {
+            if ( std::strcmp ( receivedMessage.AddressPattern(), r.addressPattern.c_str() ) == 0 )
+                route = &r;
+        }
+
+        if (route == nullptr)
+        {
+            return;
+        }
+
+        uint32 argumentCount = receivedMessage.ArgumentCount();
+
+        TrackingData trackingData;
+        TrackingKeypoint keypoints[MAX_KEYPOINTS];
+        trackingData.timestamp = m_packetTimestamp;
+        trackingData.captureTime = 0;
+        trackingData.frame = 0;
+        trackingData.numKeypoints = 0;
+
+        // Keypoints: their number, then x, y and confidence of each (",ifff...")
+        if (argumentCount >= 1 && receivedMessage.TypeTags()[0] == 'i')
+        {
+            const uint32 numKeypoints = (argumentCount - 1) / 3;
+            bool valid = (argumentCount - 1) % 3 == 0 && numKeypoints <= MAX_KEYPOINTS;
+            for (uint32 i = 1; valid && i < argumentCount; i++)
+                valid = receivedMessage.TypeTags()[i] == 'f';
+
+            osc::ReceivedMessageArgumentStream args = receivedMessage.ArgumentStream();
+            osc::int32 declared;
+            if (valid)
+            {
+                args >> declared;
+                valid = declared == (osc::int32) numKeypoints;
+            }
+            if (!valid)
+            {
+                cout << "ERROR: TrackingServer received a malformed keypoint message" << endl;
+                m_processor->receiveMalformed (m_incomingPort, route->addressId);
+                return;
+            }
+
+            for (uint32 k = 0; k < numKeypoints; k++)
+            {
+                args >> keypoints[k].x;
+                args >> keypoints[k].y;
+                args >> keypoints[k].confidence;
+            }
+            args >> osc::EndMessage;
+
+            trackingData.hasFrameInfo = false;
+            trackingData.numKeypoints = (int32) numKeypoints;
+            trackingData.position = getKeypointCentroid (keypoints, trackingData.numKeypoints);
+            m_processor->receiveMessage (m_incomingPort, route->addressId, trackingData, keypoints);
+            return;
+        }
+
+        // Either the 4 position floats, or the extended form which adds the
+        // capture time and the frame counter of the sender (",ffffhi")
+        const char* expectedTypeTags = "ffffhi";
 
-        if ( receivedMessage.ArgumentCount() != argumentCount) {
+        if ( argumentCount != 4 && argumentCount != 6 ) {
             cout << "ERROR: TrackingServer received message with wrong number of arguments. "
-                 << "Expected " << argumentCount << ", got " << receivedMessage.ArgumentCount() << endl;
+                 << "Expected 4 or 6, got " << argumentCount << endl;
+            m_processor->receiveMalformed (m_incomingPort, route->addressId);
             return;
         }
 
-        for (uint32 i = 0; i < receivedMessage.ArgumentCount(); i++)
+        for (uint32 i = 0; i < argumentCount; i++)
         {
-            if (receivedMessage.TypeTags()[i] != 'f')
+            if (receivedMessage.TypeTags()[i] != expectedTypeTags[i])
             {
-                cout << "TrackingServer only support 'f' (floats), not '"
-                     << receivedMessage.TypeTags()[i] << "'" << endl;
+                cout << "TrackingServer expects '" << expectedTypeTags[i] << "' for argument " << i
+                     << ", not '" << receivedMessage.TypeTags()[i] << "'" << endl;
+                m_processor->receiveMalformed (m_incomingPort, route->addressId);
                 return;
             }
         }
 
         osc::ReceivedMessageArgumentStream args = receivedMessage.ArgumentStream();
 
-        TrackingData trackingData;
+        trackingData.hasFrameInfo = (argumentCount == 6);
 
         // Arguments:
         args >> trackingData.position.x; // 0 - x
         args >> trackingData.position.y; // 1 - y
         args >> trackingData.position.width; // 2 - box width
         args >> trackingData.position.height; // 3 - box height
-        args >> osc::EndMessage;
-
-        for (TrackingNode* processor : m_processors)
+        if (trackingData.hasFrameInfo)
         {
-            //            String address = processor->address();
-
-            if ( std::strcmp ( receivedMessage.AddressPattern(), m_address.toStdString().c_str() ) != 0 )
-            {
-                continue;
-            }
-            // add trackingmodule to receive message call: processor->receiveMessage (m_incomingPort, m_address, trackingData);
-            processor->receiveMessage (m_incomingPort, m_address, trackingData);
+            osc::int64 captureTime;
+            osc::int32 frame;
+            args >> captureTime; // 4 - capture time
+            args >> frame; // 5 - frame counter
+            trackingData.captureTime = captureTime;
+            trackingData.frame = frame;
         }
+        args >> osc::EndMessage;
+
+        m_processor->receiveMessage (m_incomingPort, route->addressId, trackingData);
     }
     catch ( osc::Exception& e )
     {
         // any parsing errors such as unexpected argument types, or
         // missing arguments get thrown as exceptions.
         DBG ("error while parsing message: " << receivedMessage.AddressPattern() << ": " << e.what() << "\n");
+        if (route != nullptr)
+            m_processor->receiveMalformed (m_incomingPort, route->addressId);
     }
 }
 
-void TrackingServer::addProcessor (TrackingNode* processor)
+// Class TrackingReceiver methods
+TrackingReceiver::TrackingReceiver()
+    : Thread ("OscListener Thread")
+    , m_priority (DEF_THREAD_PRIORITY)
+    , m_cpu (-1)
 {
-    m_processors.push_back (processor);
+    m_multiplexer.SetReceiveBatchSize (RECEIVE_BATCH_SIZE);
 }
 
-void TrackingServer::removeProcessor (TrackingNode* processor)
+TrackingReceiver::~TrackingReceiver()
 {
-    m_processors.erase (std::remove (m_processors.begin(), m_processors.end(), processor), m_processors.end());
+    stop();
 }
 
-void TrackingServer::run()
+void TrackingReceiver::run()
 {
-    cout << "SLeeping!" << endl;
-    sleep(1000);
-    cout << "Running!" << endl;
-    // Start the oscpack OSC Listener Thread
+    // One loop serves every port of the node; it only returns on stop().
     try {
-        m_listeningSocket = new UdpListeningReceiveSocket(IpEndpointName("localhost", m_incomingPort), this);
-        sleep(1000);
-        m_listeningSocket->Run();
+        m_multiplexer.Run();
     }
     catch (const std::exception& e)
     {
-        std::cout << "Exception in TrackingServer::run(): " << e.what() << std::endl;
+        std::cout << "Exception in TrackingReceiver::run(): " << e.what() << std::endl;
     }
 }
 
-void TrackingServer::stop()
+void TrackingReceiver::stop()
 {
-    // Stop the oscpack OSC Listener Thread
     if (!isThreadRunning())
     {
         return;
     }
 
-    m_listeningSocket->AsynchronousBreak();
+    m_multiplexer.AsynchronousBreak();
+    stopThread (1000);
+}
+
+void TrackingReceiver::configure (int priority, int cpu)
+{
+    m_priority = priority;
+    m_cpu = cpu;
+
+    if (isThreadRunning())
+    {
+        stop();
+        start();
+    }
+}
+
+void TrackingReceiver::start()
+{
+    // The affinity is applied when the thread starts
+    if (m_cpu >= 0 && m_cpu < 32)
+        setAffinityMask (uint32 (1) << m_cpu);
+    else
+        setAffinityMask (0xffffffff);
+
+    startThread (m_priority);
+}
+
+void TrackingReceiver::attach (TrackingServer* server)
+{
+    m_multiplexer.AttachSocketListener (server->getSocket(), server);
+}
+
+void TrackingReceiver::detach (TrackingServer* server)
+{
+    m_multiplexer.DetachSocketListener (server->getSocket(), server);
 }
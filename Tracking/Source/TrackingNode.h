@@ -34,6 +34,7 @@
 
 #include <ProcessorHeaders.h>
 #include "TrackingMessage.h"
+#include "TrackingSharedMemory.h"
 
 #include "oscpack/osc/OscOutboundPacketStream.h"
 #include "oscpack/ip/IpEndpointName.h"
@@ -42,59 +43,304 @@
 #include "oscpack/ip/UdpSocket.h"
 
 #include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <unordered_map>
 #include <queue>
 #include <utility>
+#include <vector>
+#include <algorithm>
 
 #define BUFFER_SIZE 4096
-#define MAX_SOURCES 10
+#define MIN_BUFFER_SIZE 16
+#define MAX_BUFFER_SIZE 65536
+#define RECEIVE_BATCH_SIZE 32
+#define MAX_RECEIVE_WAIT_MS 1000
+#define STATS_HISTOGRAM_BINS 20
+#define STATS_EVENT_INTERVAL_MS 1000
+#define STATS_EVENT_LENGTH 256
+#define CLOCK_CALIBRATION_POINTS 64
+#define PENDING_EVENTS_RESERVE 1024 // on top of the queue capacities
 #define DEF_PORT 27020
 #define DEF_ADDRESS "/red"
 #define DEF_COLOR "red"
+#define DEF_INTERFACE "localhost"
+#define DEF_THREAD_PRIORITY 5
 
 using namespace std;
 
+typedef enum
+{
+    overflow_drop_oldest,
+    overflow_drop_newest
+} overflow_policy;
+
+typedef enum
+{
+    transport_udp,
+    transport_shared_memory
+} tracking_transport;
+
 /**
-    This helper class allows stores input tracking data in a circular queue.
+    This helper class stores input tracking data in a lock-free single-producer /
+    single-consumer ring buffer.
+
+    The producer is the OSC receive thread (push, clear) and the consumer is the audio
+    thread (pop). The keypoints of a message are stored out of line, in a block of
+    numKeypoints keypoints per slot that is only allocated for keypoint sources;
+    keypoints beyond that number are not kept. Neither side ever takes a lock, and
+    neither ever waits: the producer is the receive thread shared by every source of
+    the node, so a full queue must not stall it. When the producer finds the ring
+    full, the overflow policy decides whether the oldest unread entry or the new
+    entry is discarded.
 */
 class TrackingQueue
 {
 public:
 
-    TrackingQueue();
+    TrackingQueue (int capacity = BUFFER_SIZE, overflow_policy policy = overflow_drop_oldest,
+                   int numKeypoints = 0);
     ~TrackingQueue();
 
-    void push (const TrackingData &message);
-    TrackingData *pop();
+    /** Producer side. Takes the message.numKeypoints keypoints of the message, if
+        any. Returns false if the message was discarded. */
+    bool push (const TrackingData &message, const TrackingKeypoint* keypoints = nullptr);
+    /** Consumer side. Copies the message.numKeypoints keypoints kept with it to
+        keypoints, if not null. Returns false if the queue is empty. */
+    bool pop (TrackingData &message, TrackingKeypoint* keypoints = nullptr);
 
-    bool isEmpty();
+    bool isEmpty() const;
+    /** Producer side. Discards all unread entries. */
     void clear();
 
+    int getCapacity() const;
+    int getSize() const;
+    /** Keypoints kept per message */
+    int getNumKeypoints() const;
+
+    overflow_policy getOverflowPolicy() const;
+    void setOverflowPolicy (overflow_policy policy);
+
+    /** Number of pushes that found the queue full */
+    uint64 getOverrunCount() const;
+    /** Number of messages lost to overruns (old or new, depending on the policy) */
+    uint64 getDroppedCount() const;
+
 private:
-    TrackingData m_buffer[BUFFER_SIZE];
-    int m_head;
-    int m_tail;
+    HeapBlock<TrackingData> m_buffer;
+    HeapBlock<TrackingKeypoint> m_keypoints;
+    const uint64 m_mask;
+    const int m_numKeypoints;
+
+    // head is written by the producer only; tail is advanced by the consumer and,
+    // under the drop-oldest policy, by the producer when it discards an entry.
+    // They are padded apart so the two threads do not share a cache line.
+    std::atomic<uint64> m_head;
+    char m_padding[64];
+    std::atomic<uint64> m_tail;
+
+    std::atomic<int> m_policy;
+    std::atomic<uint64> m_overruns;
+    std::atomic<uint64> m_dropped;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrackingQueue);
 };
 
 /**
-    This helper class is an OSC server running its own thread to keep data transmission
-    continuous.
+    This helper class maps the shared memory ring of a tracking source, and reads
+    the records a local tracker writes into it (see TrackingSharedMemory.h).
+
+    There is no thread: the audio thread polls the ring, which takes no system call.
+    Not available on Windows, where opening a ring throws.
+*/
+class TrackingSharedRing
+{
+public:
+    /** Opens the ring of the address, creating or reinitializing it if needed.
+        Throws std::runtime_error if it cannot be mapped. */
+    TrackingSharedRing (const String& address);
+    ~TrackingSharedRing();
+
+    /** Reader side. Copies the next complete record, returns false if there is none */
+    bool read (tracking_shm_record& record);
+    /** Skips all the records written so far */
+    void skipToLatest();
+
+    /** Records overwritten by the tracker before they were read */
+    uint64 getDroppedCount() const;
+    const String& getName() const;
+
+    static String getObjectName (const String& address);
+
+private:
+    String m_name;
+    tracking_shm_header* m_header;
+    size_t m_size;
+    uint64 m_readIndex;
+    std::atomic<uint64> m_dropped;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrackingSharedRing);
+};
+
+/**
+    Lock-free ingest statistics of one tracking source.
+
+    Every counter has a single writer, the receive thread (received, malformed,
+    inter-arrival times) or the audio thread (emitted, receive-to-emit latency),
+    and may be read from any thread. Histogram bin 0 counts times below 1 us,
+    bin k times in [2^(k-1), 2^k) us, and the last bin all longer times.
+*/
+class TrackingStatistics
+{
+public:
+    TrackingStatistics();
+
+    void reset();
+
+    /** Receive thread. Takes the software timestamp the message was stamped with. */
+    void addReceived (int64 receiveTimestamp);
+    void addMalformed();
+    /** Audio thread. Takes the receive and emit software timestamps. */
+    void addEmitted (int64 receiveTimestamp, int64 emitTimestamp);
+
+    uint64 getReceivedCount() const;
+    uint64 getMalformedCount() const;
+    uint64 getEmittedCount() const;
+    /** Message rate in Hz, from the smoothed inter-arrival time */
+    double getRate() const;
+    /** Smoothed inter-arrival jitter in microseconds (as in RFC 3550) */
+    double getJitter() const;
+    /** Copies STATS_HISTOGRAM_BINS counts */
+    void getInterArrivalHistogram (uint64* bins) const;
+    void getLatencyHistogram (uint64* bins) const;
+
+    /** Upper bound of the bin, in microseconds */
+    static double getBinLimit (int bin);
+    /** Upper bound of the bin holding the given fraction of the counts */
+    static double getPercentile (const uint64* bins, double fraction);
+
+private:
+    static int getBin (double micros);
+    static double ticksToMicros (int64 ticks);
+
+    std::atomic<uint64> m_received;
+    std::atomic<uint64> m_malformed;
+    std::atomic<uint64> m_emitted;
+    std::atomic<uint64> m_interArrival[STATS_HISTOGRAM_BINS];
+    std::atomic<uint64> m_latency[STATS_HISTOGRAM_BINS];
+    std::atomic<double> m_meanInterval;
+    std::atomic<double> m_jitter;
+
+    // receive thread only
+    int64 m_lastReceive;
+    double m_lastInterval;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrackingStatistics);
+};
+
+/**
+    Receive settings of a TrackingNode, shared by all its sockets and its receive
+    thread. Sizes and times of 0, and a cpu of -1, keep the system defaults.
+*/
+struct TrackingReceiveSettings
+{
+    String interfaceAddress = DEF_INTERFACE;
+    int receiveBufferSize = 0;      // SO_RCVBUF, bytes
+    int busyPollMicros = 0;         // SO_BUSY_POLL, microseconds
+    int threadPriority = DEF_THREAD_PRIORITY; // JUCE priority, 0 to 10 (highest)
+    int cpu = -1;                   // core the receive thread is pinned to
+};
+
+/**
+    This helper class relates the clocks a tracking sample goes through: the kernel
+    receive time of its datagram, the software timestamp (high resolution ticks) it
+    is stamped with, and the acquisition sample clock.
+
+    The sample clock mapping is a least-squares fit over the (software timestamp,
+    sample clock) pairs of the last CLOCK_CALIBRATION_POINTS processed blocks,
+    which smooths out the jitter of getGlobalTimestamp. The samples of a block
+    were all acquired by the time it is processed, so each pair is the time of the
+    process() call and the end of its block.
+*/
+class TrackingClock
+{
+public:
+    TrackingClock();
+
+    /** Receive thread. Converts a kernel receive time (ns since the epoch) into a
+        software timestamp by subtracting how long the datagram waited since the
+        kernel stamped it. Falls back to the current software timestamp when the
+        receive time is missing or implausible. */
+    static int64 receiveTimeToSoftwareTimestamp (long long receiveTimeNs);
+
+    /** Audio thread. Adds the clock readings taken at the start of process(). */
+    void addCalibrationPoint (int64 softwareTimestamp, int64 sampleTimestamp);
+    /** Audio thread. Returns the sample clock time of a software timestamp, or -1
+        before two calibration points were added. */
+    int64 softwareToSampleTimestamp (int64 softwareTimestamp) const;
+    /** Discards the calibration, e.g. when acquisition restarts */
+    void reset();
+
+private:
+    int64 m_software[CLOCK_CALIBRATION_POINTS];
+    int64 m_samples[CLOCK_CALIBRATION_POINTS];
+    int m_count;
+    int m_next;
+
+    // sample = m_sampleOrigin + m_slope * (software - m_softwareOrigin)
+    bool m_isCalibrated;
+    double m_slope;
+    int64 m_softwareOrigin;
+    double m_sampleOrigin;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrackingClock);
+};
+
+/**
+    This helper class is an OSC server listening on one UDP port. It owns the bound
+    socket, but no thread: packets are received by the TrackingReceiver it is
+    attached to.
+
+    All the sources of a node that share a port share its server, which routes
+    each message to the source whose address it carries. A packet may be a single
+    message or an OSC bundle of messages for several sources; every message of a
+    packet is stamped with the same receive timestamp. Where the platform supports
+    it, that is the kernel receive time of the datagram mapped by TrackingClock.
+
+    The expected messages are decoded straight from the datagram bytes without
+    exceptions or allocations; any other element goes through the generic oscpack
+    parser. A message is a source address followed by either
+        ,ffff    x, y, width, height
+        ,ffffhi  x, y, width, height, capture time (int64, microseconds since the
+                 epoch on the sender clock), frame counter (int32)
+        ,ifff... number of keypoints N (at most MAX_KEYPOINTS), then x, y and
+                 confidence of each; the position is their centroid
 */
 
 class TrackingNode;
 
-class TrackingServer: public osc::OscPacketListener,
-    public Thread
+class TrackingServer: public osc::OscPacketListener
 {
 public:
-    TrackingServer ();
-    TrackingServer (int port, String address);
+    TrackingServer (int port, const TrackingReceiveSettings& settings, TrackingNode* processor);
     ~TrackingServer();
 
-    void run();
-    void stop();
+    UdpSocket* getSocket();
+    int getPort() const;
 
-    void addProcessor (TrackingNode* processor);
-    void removeProcessor (TrackingNode* processor);
+    /** Applies the socket options; the bind interface only counts at construction */
+    void applySettings (const TrackingReceiveSettings& settings);
+
+    /** Routes are only changed while the server is detached from its receiver.
+        The address id is the one interned by the TrackingNode. */
+    void addAddress (const String& address, int addressId);
+    void removeAddress (const String& address);
+    bool hasAddresses() const;
+
+    void ProcessPacket (const char* data, int size, const IpEndpointName& remoteEndpoint) override;
+    void ProcessPacketBatch (const char* const* data, const int* sizes, const IpEndpointName* remoteEndpoints,
+                             const long long* receiveTimesNs, int count) override;
 
 protected:
     virtual void ProcessMessage (const osc::ReceivedMessage& m, const IpEndpointName&);
@@ -103,11 +349,69 @@ private:
     TrackingServer (TrackingServer const&);
     void operator= (TrackingServer const&);
 
+    // The decoder unit tests, see Benchmark/TrackingTests.cpp
+    friend class TrackingServerTests;
+
+    struct Route
+    {
+        String address;
+        int addressId;
+        // OSC encoding of the address pattern, built once: the fast path only has
+        // to compare these bytes and the type tags, then read the arguments.
+        std::string addressPattern;
+        std::string paddedAddress;
+    };
+
+    /** Builds the route of an address, with its OSC encoding */
+    static Route makeRoute (const String& address, int addressId);
+    /** Handles a message or a bundle, recursing into nested bundles */
+    void processElement (const char* data, int size, const IpEndpointName& remoteEndpoint);
+    /** Decodes a ",ffff", ",ffffhi" or ",ifff..." message sent to the route address,
+        the keypoints of the latter to keypoints, which holds MAX_KEYPOINTS. Returns
+        false if the element has any other layout. */
+    static bool decodeMessage (const Route& route, const char* data, int size, TrackingData& trackingData,
+                               TrackingKeypoint* keypoints);
+
     int m_incomingPort;
-    String m_address;
+    TrackingNode* m_processor;
+    std::vector<Route> m_routes;
+
+    // receive timestamp of the packet being processed
+    int64 m_packetTimestamp;
+
+    UdpReceiveSocket *m_socket = nullptr;
+};
+
+/**
+    This helper class runs the single receive loop shared by all the sources of a
+    TrackingNode. Servers are attached and detached while the loop is running, so
+    adding, removing or editing a source never starts or joins a thread. Up to
+    RECEIVE_BATCH_SIZE datagrams are drained from a ready socket per system call.
+*/
+class TrackingReceiver: public Thread
+{
+public:
+    TrackingReceiver();
+    ~TrackingReceiver();
+
+    void run() override;
+    void stop();
+
+    /** Sets the priority and the core of the receive thread, restarting it if it is
+        running. Attached servers stay attached. */
+    void configure (int priority, int cpu);
+    /** Starts the receive thread with the configured priority and core */
+    void start();
 
-    UdpListeningReceiveSocket *m_listeningSocket = nullptr;
-    std::vector<TrackingNode*> m_processors;
+    void attach (TrackingServer* server);
+    void detach (TrackingServer* server);
+
+private:
+    SocketReceiveMultiplexer m_multiplexer;
+    int m_priority;
+    int m_cpu;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrackingReceiver);
 };
 
 
@@ -116,7 +420,7 @@ private:
 
     @see TrackingNodeEditor
 */
-class TrackingNode : public GenericProcessor
+class TrackingNode : public GenericProcessor, private Timer
 {
 public:
     /** The class constructor, used to initialize any members. */
@@ -126,14 +430,22 @@ public:
 
     AudioProcessorEditor* createEditor();
     void updateSettings() override;
+    bool enable() override;
+    bool disable() override;
     void process (AudioSampleBuffer&) override;
     bool isReady() override;
     void saveCustomParametersToXml(XmlElement* parentElement) override;
     void loadCustomParametersFromXml() override;
 
-    void receiveMessage (int port, String address, const TrackingData &message);
-    int getTrackingModuleIndex(int port, String address);
-    void addSource (int port, String address, String color);
+    /** Receive thread. keypoints holds the message.numKeypoints keypoints of the message */
+    void receiveMessage (int port, int addressId, const TrackingData &message,
+                         const TrackingKeypoint* keypoints = nullptr);
+    /** Counts a message sent to the source that could not be decoded */
+    void receiveMalformed (int port, int addressId);
+    int getTrackingModuleIndex(int port, const String& address);
+    void addSource (int port, String address, String color,
+                    int queueSize = BUFFER_SIZE, overflow_policy policy = overflow_drop_oldest,
+                    tracking_transport transport = transport_udp);
     void addSource ();
     void removeSource (int i);
     int getNSources();
@@ -143,54 +455,205 @@ public:
     String getAddress(int i);
     void setPort (int i,int port);
     int getPort(int i);
+    /** Why source i could not listen on its port or ring, or an empty string if it does */
+    String getBindError(int i);
+    /** Number of keypoints in the events of source i, after its position, and their
+        comma separated names; declared on its channel at the next signal chain update */
+    void setKeypoints (int i, int numKeypoints);
+    int getKeypoints(int i);
+    void setKeypointNames (int i, String names);
+    String getKeypointNames(int i);
+    /** Bounded-latency ingest: a latest-only source emits only the freshest of the
+        messages received during a block, and messages older than the max age (in
+        ms, 0 for no limit) are dropped instead of emitted */
+    void setLatestOnly (int i, bool latestOnly);
+    bool getLatestOnly(int i);
+    void setMaxAge (int i, int maxAgeMs);
+    int getMaxAge(int i);
+    /** UDP (OSC on the port) or the shared memory ring of the address */
+    void setTransport (int i, tracking_transport transport);
+    tracking_transport getTransport(int i);
     void setColor (int i, String color);
     String getColor(int i);
+    void setQueueSize (int i, int size);
+    int getQueueSize(int i);
+    void setOverflowPolicy (int i, overflow_policy policy);
+    overflow_policy getOverflowPolicy(int i);
+
+    /** Messages lost to queue overruns */
+    uint64 getDroppedCount(int i);
+    /** Frames the sender numbered but never arrived, for sources sending ",ffffhi" */
+    uint64 getFrameGapCount(int i);
+    /** Frames that arrived late or twice */
+    uint64 getFrameReorderCount(int i);
+
+    /** Ingest statistics of source i, or nullptr. Only valid until the sources change. */
+    const TrackingStatistics* getStatistics(int i);
+    /** Statistics of source i and the state of its queue, on one line */
+    String getStatisticsSummary(int i);
+
+    /** Rebinds the sources if the interface changed, and updates the socket
+        options and the receive thread of the node */
+    void setReceiveSettings (const TrackingReceiveSettings& settings);
+    const TrackingReceiveSettings& getReceiveSettings() const;
+
+    /** In frame mode, the sources share a single "Tracking frames" event channel,
+        with one TrackingFrame event per camera frame, instead of one channel each.
+        Takes effect at the next signal chain update. */
+    void setFrameChannelMode (bool frameMode);
+    bool getFrameChannelMode() const;
 
 private:
 
     class TrackingModule
     {
     public:
-        TrackingModule(int port, String address, String color, TrackingNode *processor)
+        TrackingModule(int port, String address, String color, TrackingNode *processor,
+                       int queueSize = BUFFER_SIZE, overflow_policy policy = overflow_drop_oldest,
+                       tracking_transport transport = transport_udp, int numKeypoints = 0)
             : m_port(port)
             , m_address(address)
             , m_color(color)
-            , m_messageQueue(new TrackingQueue())
-            , m_server(new TrackingServer(port, address))
+            , m_messageQueue(new TrackingQueue(queueSize, policy, numKeypoints))
+            , m_processor(processor)
+            , m_transport(transport)
+            , m_keypoints(numKeypoints)
+            , m_metadata(buildMetadata())
         {
-            m_server->addProcessor(processor);
-            m_server->startThread();
+            try
+            {
+                if (transport == transport_shared_memory)
+                    m_sharedRing = new TrackingSharedRing(address);
+                else
+                    m_server = m_processor->acquireServer(port, address);
+            }
+            catch (const std::runtime_error&)
+            {
+                delete m_messageQueue.load();
+                delete m_metadata.load();
+                throw;
+            }
         }
         TrackingModule(TrackingNode *processor)
             : m_port(0)
             , m_address("")
             , m_color("")
             , m_messageQueue(new TrackingQueue())
-            , m_server(new TrackingServer())
+            , m_processor(processor)
+            , m_metadata(buildMetadata())
         {
         }
         ~TrackingModule() {
+            unbind();
             if (m_messageQueue)
             {
-                cout << "Deleting message queue" << endl;
-                delete m_messageQueue;
+                delete m_messageQueue.load();
+            }
+            delete m_metadata.load();
+            if (m_sharedRing)
+            {
+                delete m_sharedRing;
             }
+        }
+        /** Stops routing the address of the module to it; message thread only */
+        void unbind()
+        {
             if (m_server)
             {
-                m_server->stop();
-                cout << "Stopping thread" << endl;
-                m_server->stopThread(-1);
-                cout << "Waiting for exit" << endl;
-                m_server->waitForThreadToExit(-1);
-                cout << "Delete server" << endl;
-                delete m_server;
+                m_processor->releaseServer(m_server, m_address);
+                m_server = nullptr;
             }
         }
         int m_port = -1;
         String m_address;
         String m_color;
-        TrackingQueue *m_messageQueue = nullptr;
+        // Swapped by replaceQueue() while the receive and audio threads may use it
+        std::atomic<TrackingQueue*> m_messageQueue {nullptr};
         TrackingServer *m_server = nullptr;
+        TrackingNode *m_processor = nullptr;
+        String m_bindError;
+        tracking_transport m_transport = transport_udp;
+        int m_keypoints = 0;
+        String m_keypointNames;
+        // Coalescing settings, edited while process() reads them, and what they discarded
+        std::atomic<bool> m_latestOnly {false};
+        std::atomic<int> m_maxAgeMs {0};
+        std::atomic<uint64> m_coalesced {0};
+        std::atomic<uint64> m_expired {0};
+        // Only for the shared memory transport, polled by process()
+        TrackingSharedRing *m_sharedRing = nullptr;
+        // Set by enable(); the receive thread clears the queue, of which it is the
+        // producer, before it pushes the first message of the acquisition
+        std::atomic<bool> m_clearPending {false};
+
+        // Frame counter bookkeeping, written by the receive thread
+        bool m_hasLastFrame = false;
+        int32 m_lastFrame = 0;
+        std::atomic<uint64> m_frameGaps {0};
+        std::atomic<uint64> m_frameReorders {0};
+
+        void countFrame(int32 frame)
+        {
+            if (m_hasLastFrame)
+            {
+                // Wrapping difference, so the counter may roll over
+                const int32 delta = int32 (uint32 (frame) - uint32 (m_lastFrame));
+                if (delta <= 0)
+                {
+                    m_frameReorders.fetch_add (1, std::memory_order_relaxed);
+                    return;
+                }
+                if (delta > 1)
+                    m_frameGaps.fetch_add (uint64 (delta - 1), std::memory_order_relaxed);
+            }
+            m_lastFrame = frame;
+            m_hasLastFrame = true;
+        }
+        void resetFrameCounters()
+        {
+            m_hasLastFrame = false;
+            m_frameGaps = 0;
+            m_frameReorders = 0;
+        }
+
+        TrackingStatistics m_statistics;
+
+        // Moved by the receive thread after each push; process() drains the queue
+        // when it differs from the epoch it drained last.
+        std::atomic<uint64> m_epoch {0};
+        uint64 m_drainedEpoch = 0;
+
+        // Event metadata, encoded on the message thread whenever the color, port or
+        // address change, and swapped in by replaceMetadata(): process() never reads
+        // the strings the editor writes. The capture time and frame values are
+        // overwritten by process() for each event.
+        struct EventMetadata
+        {
+            MetaDataValueArray values;
+            MetaDataValuePtr captureTime;
+            MetaDataValuePtr frame;
+        };
+        std::atomic<EventMetadata*> m_metadata {nullptr};
+
+        EventMetadata* buildMetadata() const
+        {
+            auto* metadata = new EventMetadata();
+            MetaDataValuePtr color = new MetaDataValue(MetaDataDescriptor::CHAR, 15);
+            color->setValue(m_color.toLowerCase());
+            metadata->values.add(color);
+            MetaDataValuePtr port = new MetaDataValue(MetaDataDescriptor::INT32, 1);
+            port->setValue(m_port);
+            metadata->values.add(port);
+            MetaDataValuePtr address = new MetaDataValue(MetaDataDescriptor::CHAR, 15);
+            address->setValue(m_address.toLowerCase());
+            metadata->values.add(address);
+            metadata->captureTime = new MetaDataValue(MetaDataDescriptor::INT64, 1);
+            metadata->values.add(metadata->captureTime);
+            metadata->frame = new MetaDataValue(MetaDataDescriptor::INT32, 1);
+            metadata->values.add(metadata->frame);
+            return metadata;
+        }
+
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrackingModule);
     };
 
@@ -199,13 +662,123 @@ private:
 
     CriticalSection lock;
 
-    bool m_positionIsUpdated;
+    ScopedPointer<TrackingReceiver> m_receiver;
+    TrackingReceiveSettings m_receiveSettings;
+    TrackingClock m_clock;
+    // one server per port, shared by the modules listening on it
+    Array<TrackingServer*> m_servers;
+
+    /** Returns the server for the port, binding it if needed, and routes the address
+        to it. Throws std::runtime_error if the port cannot be bound. */
+    TrackingServer* acquireServer (int port, const String& address);
+    /** Removes the address from the server, closing it once no address is left */
+    void releaseServer (TrackingServer* server, const String& address);
+
+    // Ingest routing: (port, interned address id) -> module. The table is rebuilt
+    // under the lock whenever modules are added, replaced or removed, and a module
+    // is only deleted once it is out of the table.
+    StringArray m_internedAddresses;
+    std::unordered_map<uint64, TrackingModule*> m_routingTable;
+
+    int internAddress (const String& address);
+    void updateRoutingTable();
+    /** Removes the modules from the array and the routing table, unbinds them and
+        retires them */
+    void deleteModules (Array<TrackingModule*> modules);
+    /** Builds a module bound to the port and address. If binding fails, reports the
+        error and returns an unbound module holding the settings and the error. */
+    TrackingModule* createModule (int port, const String& address, const String& color,
+                                  int queueSize, overflow_policy policy, tracking_transport transport,
+                                  int numKeypoints, const String& action);
+    /** Rebinds source i to the port, address and transport, keeping its other settings */
+    void replaceModule (int i, int port, const String& address, tracking_transport transport,
+                        const String& action);
+    /** Moves the records written to the ring of a shared memory source to its queue */
+    void pollSharedRing (TrackingModule* module);
+    /** True, with a status message, if sources cannot be added or removed now */
+    bool rejectSourceChange (const String& action);
+
+    // process() does not read trackingModules, which the message thread edits, but
+    // an immutable snapshot of it, published whenever the sources change. Replaced
+    // snapshots and removed modules are retired, and only deleted once process() is
+    // done with them: m_readerEpoch is odd while process() holds a snapshot, so a
+    // retired entry is free once the epoch was even at retirement, or has moved.
+    struct ModuleSnapshot
+    {
+        Array<TrackingModule*> modules;
+    };
+    struct RetiredModules
+    {
+        ModuleSnapshot* snapshot;
+        Array<TrackingModule*> modules;
+        TrackingQueue* queue;
+        TrackingModule::EventMetadata* metadata;
+        uint64 readerEpoch;
+    };
+    std::atomic<ModuleSnapshot*> m_moduleSnapshot {nullptr};
+    std::atomic<uint64> m_readerEpoch {0};
+    std::vector<RetiredModules> m_retired;
+
+    /** Publishes a snapshot of trackingModules, retiring the previous one with the
+        removed modules, and the replaced queue and metadata */
+    void publishModules (const Array<TrackingModule*>& removed = Array<TrackingModule*>(),
+                         TrackingQueue* replacedQueue = nullptr,
+                         TrackingModule::EventMetadata* replacedMetadata = nullptr);
+    /** Gives the module a new queue; the old one is retired like a removed module */
+    void replaceQueue (TrackingModule* module, TrackingQueue* queue);
+    /** Encodes the event metadata of the module again, retiring the old one */
+    void replaceMetadata (TrackingModule* module);
+    /** Deletes the retired entries process() is done with, or all of them */
+    void reclaimRetired (bool force);
+    static String summarizeStatistics (const TrackingModule* module);
+
+    // Messages popped by process(), sorted by receive time across sources before
+    // they are emitted at their sample offset
+    struct PendingEvent
+    {
+        TrackingData message;
+        int module;
+        int sampleOffset;
+        int sequence;
+        // First of its message.numKeypoints keypoints in m_pendingKeypoints
+        int keypointIndex;
+    };
+    std::vector<PendingEvent> m_pendingEvents;
+    std::vector<TrackingKeypoint> m_pendingKeypoints;
+
+    /** Whether one more event of the module fits in the pending events without
+        reallocating them */
+    bool hasPendingRoom (int module) const;
+    /** Places a popped message of the module at its sample offset in the block and
+        adds it, with its keypoints if not null, to the pending events */
+    void addPendingEvent (TrackingModule* module, PendingEvent& pending, const TrackingKeypoint* keypoints,
+                          int64 now, int64 blockStart, int nSamples);
+
+    /** Packs the sorted pending events into TrackingFrame events. Consecutive
+        messages belong to the same frame if they carry the same frame counter, or
+        without one, if they came in the same packet (same receive timestamp). */
+    void emitFrameEvents (int64 blockStart);
+
+    bool m_frameChannelMode = false;
+    const EventChannel* m_frameChannel = nullptr;
+
     bool m_isRecordingTimeLogged;
     bool m_isAcquisitionTimeLogged;   
     int m_received_msg;
 
     Array<TrackingModule*> trackingModules;
     Array<const EventChannel*> moduleEventChannels;
+    // Keypoints in the events of each channel, as declared by updateSettings()
+    Array<int> moduleChannelKeypoints;
+    const EventChannel* m_statisticsChannel = nullptr;
+    // Statistics texts, formatted every STATS_EVENT_INTERVAL_MS by timerCallback() on
+    // the message thread. It only rewrites them while m_statisticsReady is clear,
+    // and process() clears it once it has emitted them, so the audio thread never
+    // formats a String nor releases the last reference to one.
+    StringArray m_statisticsText;
+    std::atomic<bool> m_statisticsReady {false};
+
+    void timerCallback() override;
     int lastNumInputs;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrackingNode);
@@ -36,7 +36,7 @@ TrackingNodeEditor::TrackingNodeEditor (GenericProcessor* parentNode, bool useDe
     : GenericEditor (parentNode, useDefaultParameterEditors)
     , selectedSource(0)
 {
-    desiredWidth = 220;
+    desiredWidth = 270;
 
     TrackingNode* processor = (TrackingNode*) getProcessor();
 
@@ -81,6 +81,16 @@ TrackingNodeEditor::TrackingNodeEditor (GenericProcessor* parentNode, bool useDe
     labelPort->addListener (this);
     addAndMakeVisible (labelPort);
 
+    // UDP: OSC messages on the port. SHM: the shared memory ring named after the address
+    transportSelector = new ComboBox();
+    transportSelector->setBounds (165, 60, 45, 18);
+    transportSelector->addItem ("UDP", transport_udp + 1);
+    transportSelector->addItem ("SHM", transport_shared_memory + 1);
+    transportSelector->setSelectedId (transport_udp + 1, dontSendNotification);
+    transportSelector->setTooltip ("Receive the source over UDP, or from a local tracker through shared memory");
+    transportSelector->addListener (this);
+    addAndMakeVisible (transportSelector);
+
     adrLabel = new Label ("Address", "Address:");
     adrLabel->setBounds (10, 80, 140, 25);
     addAndMakeVisible (adrLabel);
@@ -95,6 +105,17 @@ TrackingNodeEditor::TrackingNodeEditor (GenericProcessor* parentNode, bool useDe
     labelAdr->addListener (this);
     addAndMakeVisible (labelAdr);
 
+    // Number of keypoints carried by the events of the source, 0 for a plain box
+    labelKeypoints = new Label ("Keypoints", "0");
+    labelKeypoints->setBounds (165, 85, 45, 18);
+    labelKeypoints->setFont (Font ("Default", 15, Font::plain));
+    labelKeypoints->setColour (Label::textColourId, Colours::white);
+    labelKeypoints->setColour (Label::backgroundColourId, Colours::grey);
+    labelKeypoints->setTooltip ("Keypoints per message (\",ifff...\"), 0 for a single box");
+    labelKeypoints->setEditable (true);
+    labelKeypoints->addListener (this);
+    addAndMakeVisible (labelKeypoints);
+
     colorLabel = new Label ("Color", "Color:");
     colorLabel->setBounds (10, 105, 140, 25);
     addAndMakeVisible (colorLabel);
@@ -107,10 +128,65 @@ TrackingNodeEditor::TrackingNodeEditor (GenericProcessor* parentNode, bool useDe
         colorSelector->addItem(color_palette[i], i+1);
     colorSelector->setSelectedId(1, dontSendNotification);
     addAndMakeVisible(colorSelector);
+
+    // Rate, jitter and drops of the selected source; the tooltip has the full summary
+    statsLabel = new Label ("Stats", "");
+    statsLabel->setBounds (10, 130, 200, 15);
+    statsLabel->setFont (Font ("Default", 11, Font::plain));
+    addAndMakeVisible (statsLabel);
+
+    // All sources packed into one "Tracking frames" channel instead of one channel each
+    frameButton = new UtilityButton ("frames", titleFont);
+    frameButton->addListener (this);
+    frameButton->setRadius (3.0f);
+    frameButton->setClickingTogglesState (true);
+    frameButton->setTooltip ("Emit one event per frame with all sources, on a single channel");
+    frameButton->setBounds (165, 110, 45, 18);
+    addAndMakeVisible (frameButton);
+
+    // Coalescing of the selected source, for closed-loop use: only the freshest
+    // message of each block, and no message older than the max age
+    latestButton = new UtilityButton ("latest", titleFont);
+    latestButton->addListener (this);
+    latestButton->setRadius (3.0f);
+    latestButton->setClickingTogglesState (true);
+    latestButton->setTooltip ("Emit only the most recent message of the source in each block");
+    latestButton->setBounds (215, 60, 50, 18);
+    addAndMakeVisible (latestButton);
+
+    labelMaxAge = new Label ("Max age", "0");
+    labelMaxAge->setBounds (215, 85, 50, 18);
+    labelMaxAge->setFont (Font ("Default", 15, Font::plain));
+    labelMaxAge->setColour (Label::textColourId, Colours::white);
+    labelMaxAge->setColour (Label::backgroundColourId, Colours::grey);
+    labelMaxAge->setTooltip ("Drop messages older than this many ms, 0 to keep them all");
+    labelMaxAge->setEditable (true);
+    labelMaxAge->addListener (this);
+    addAndMakeVisible (labelMaxAge);
+    startTimer (STATS_REFRESH_MS);
 }
 
 TrackingNodeEditor::~TrackingNodeEditor()
 {
+    stopTimer();
+}
+
+void TrackingNodeEditor::timerCallback()
+{
+    TrackingNode* p = (TrackingNode*) getProcessor();
+    const TrackingStatistics* stats = p->getStatistics (selectedSource);
+    if (stats == nullptr)
+    {
+        statsLabel->setText ("", dontSendNotification);
+        statsLabel->setTooltip ("");
+        return;
+    }
+
+    uint64 lost = stats->getMalformedCount() + p->getDroppedCount (selectedSource)
+                  + p->getFrameGapCount (selectedSource);
+    statsLabel->setText (String (stats->getRate(), 1) + " Hz  jitter " + String (stats->getJitter() / 1000.0, 2)
+                         + " ms  lost " + String (lost), dontSendNotification);
+    statsLabel->setTooltip (p->getStatisticsSummary (selectedSource));
 }
 
 void TrackingNodeEditor::labelTextChanged (Label* label)
@@ -125,6 +201,21 @@ void TrackingNodeEditor::labelTextChanged (Label* label)
         p->setColor(selectedSource, color_palette[colorSelector->getSelectedId()-1]);
     }
 
+    if (label == labelKeypoints)
+    {
+        Value val = label->getTextValue();
+        p->setKeypoints (selectedSource, val.getValue());
+        // The channel declares the keypoints
+        if (!CoreServices::getAcquisitionStatus())
+            CoreServices::updateSignalChain(this);
+    }
+
+    if (label == labelMaxAge)
+    {
+        Value val = label->getTextValue();
+        p->setMaxAge (selectedSource, val.getValue());
+    }
+
     if (label == labelPort)
     {
         Value val = label->getTextValue();
@@ -141,11 +232,20 @@ void TrackingNodeEditor::comboBoxChanged(ComboBox* c)
         selectedSource = c->getSelectedId() - 1;
         updateLabels();
     }
+    else if (c == transportSelector)
+    {
+        TrackingNode* p = (TrackingNode*) getProcessor();
+        p->setTransport (selectedSource, (tracking_transport) (c->getSelectedId() - 1));
+        updateLabels();
+    }
     else if (c == colorSelector)
     {
         TrackingNode* p = (TrackingNode*) getProcessor();
         String color = color_palette[c->getSelectedId() - 1];
         p->setColor (selectedSource, color);
+        // Frame channels carry the colors in their channel metadata
+        if (p->getFrameChannelMode() && !CoreServices::getAcquisitionStatus())
+            CoreServices::updateSignalChain(this);
     }
 }
 
@@ -157,6 +257,15 @@ void TrackingNodeEditor::updateLabels()
     TrackingNode* p = (TrackingNode*) getProcessor();
     labelAdr->setText(p->getAddress(selectedSource), dontSendNotification);
     labelPort->setText(String(p->getPort(selectedSource)), dontSendNotification);
+    transportSelector->setSelectedId (p->getTransport(selectedSource) + 1, dontSendNotification);
+    labelKeypoints->setText(String(p->getKeypoints(selectedSource)), dontSendNotification);
+    latestButton->setToggleState (p->getLatestOnly(selectedSource), dontSendNotification);
+    labelMaxAge->setText(String(p->getMaxAge(selectedSource)), dontSendNotification);
+
+    // A source whose port could not be bound keeps its settings, flagged here
+    const String bindError = p->getBindError(selectedSource);
+    labelPort->setColour (Label::backgroundColourId, bindError.isEmpty() ? Colours::grey : Colours::darkred);
+    labelPort->setTooltip (bindError);
 
     for (int i=0; i < MAX_SOURCES; i++)
     {
@@ -168,6 +277,29 @@ void TrackingNodeEditor::updateLabels()
 void TrackingNodeEditor::buttonEvent(Button* button)
 {
     TrackingNode* p = (TrackingNode*) getProcessor();
+    if (button == frameButton)
+    {
+        if (CoreServices::getAcquisitionStatus())
+        {
+            frameButton->setToggleState (p->getFrameChannelMode(), dontSendNotification);
+            CoreServices::sendStatusMessage("Stop acquisition to change the tracking channel mode");
+            return;
+        }
+        p->setFrameChannelMode (frameButton->getToggleState());
+        CoreServices::updateSignalChain(this);
+        return;
+    }
+    if (button == latestButton)
+    {
+        p->setLatestOnly (selectedSource, latestButton->getToggleState());
+        return;
+    }
+    if (CoreServices::getAcquisitionStatus())
+    {
+        // Each source has its own event channel, created when acquisition started
+        CoreServices::sendStatusMessage("Stop acquisition to add or remove tracking sources");
+        return;
+    }
     if (button == plusButton && p->getNSources() < MAX_SOURCES)
         addTrackingSource();
     else if (button == minusButton && p->getNSources() > 1)
@@ -208,5 +340,6 @@ void TrackingNodeEditor::updateSettings()
         sourceSelector->addItem("Tracking source " + String(i+1), i+1);
 
     sourceSelector->setSelectedId(selectedSource+1);
+    frameButton->setToggleState (p->getFrameChannelMode(), dontSendNotification);
     updateLabels();
 }
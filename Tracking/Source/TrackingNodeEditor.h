@@ -33,13 +33,15 @@
 #define TRACKINGNODEEDITOR_H
 
 #define MAX_SOURCES 10
+#define STATS_REFRESH_MS 500
 
 #include <EditorHeaders.h>
 
 class TrackingNodeEditor :
         public GenericEditor,
         public Label::Listener,
-        public ComboBox::Listener
+        public ComboBox::Listener,
+        private Timer
 {
 public:
     TrackingNodeEditor (GenericProcessor* parentNode, bool useDefaultParameterEditors);
@@ -53,6 +55,8 @@ public:
     void updateLabels();
 
 private:
+    void timerCallback() override;
+
 	Array<String> color_palette;
     ScopedPointer<ComboBox> sourceSelector;
     ScopedPointer<UtilityButton> plusButton;
@@ -64,12 +68,18 @@ private:
 
     ScopedPointer<Label> positionLabel;
     ScopedPointer<Label> labelPort;
+    ScopedPointer<ComboBox> transportSelector;
     ScopedPointer<Label> portLabel;
     ScopedPointer<Label> labelAdr;
     ScopedPointer<Label> adrLabel;
+    ScopedPointer<Label> labelKeypoints;
     ScopedPointer<Label> labelColor;
     ScopedPointer<Label> colorLabel;
     ScopedPointer<ComboBox> colorSelector;
+    ScopedPointer<Label> statsLabel;
+    ScopedPointer<UtilityButton> frameButton;
+    ScopedPointer<UtilityButton> latestButton;
+    ScopedPointer<Label> labelMaxAge;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrackingNodeEditor);
 
@@ -0,0 +1,120 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TRACKINGSHAREDMEMORY_H
+#define TRACKINGSHAREDMEMORY_H
+
+/*
+    Shared memory transport of the Tracking Port.
+
+    This header is plain C, so that a tracker running on the same machine can
+    include it. A source set to the shared memory transport maps the POSIX shared
+    memory object named TRACKING_SHM_PREFIX followed by its address, with every '/'
+    replaced by '_' (address "/red" -> "/oe_tracking_red"). The Tracking Port creates
+    and initializes the object with mode 0600, so the tracker must run as the same
+    user as the GUI; it opens it with shm_open (name, O_RDWR, 0), maps it and calls
+    tracking_shm_write() for each sample. The object is never
+    unlinked by the Tracking Port, so the tracker may keep it mapped while sources
+    are edited.
+
+    Layout: a 64 byte tracking_shm_header, followed by header->capacity records of
+    header->recordSize bytes. There is a single writer. Record i goes to slot
+    i % capacity, and is guarded by its sequence number, which is 2i+1 while it is
+    written and 2i+2 once it is complete. The header write index counts the
+    complete records. A reader that falls more than capacity records behind loses
+    the oldest ones; the writer never waits. The Tracking Port checks the header
+    when it maps the object, but always indexes the records with the compile-time
+    TRACKING_SHM_CAPACITY, so a header changed afterwards cannot make it read
+    outside the mapping.
+*/
+
+#include <stdint.h>
+
+#define TRACKING_SHM_MAGIC 0x4b525454u /* "TTRK" */
+#define TRACKING_SHM_VERSION 1
+#define TRACKING_SHM_CAPACITY 1024
+#define TRACKING_SHM_PREFIX "/oe_tracking"
+
+/* captureTime and frame are set */
+#define TRACKING_SHM_FRAME_INFO 0x1u
+
+typedef struct tracking_shm_record
+{
+    uint64_t sequence;
+    int64_t writeTimeNs;   /* CLOCK_REALTIME when written, ns since the epoch, 0 if unknown */
+    int64_t captureTime;   /* sender clock, microseconds since the epoch */
+    int32_t frame;         /* sender frame counter */
+    uint32_t flags;
+    float x;
+    float y;
+    float width;
+    float height;
+} tracking_shm_record;
+
+typedef struct tracking_shm_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;     /* a power of two */
+    uint32_t recordSize;
+    uint64_t writeIndex;
+    uint8_t reserved[40];
+} tracking_shm_header;
+
+static inline tracking_shm_record* tracking_shm_records (tracking_shm_header* header)
+{
+    return (tracking_shm_record*) (header + 1);
+}
+
+#if defined(__GNUC__)
+/* Writer side. Fills in the sequence number; the other fields come from the caller. */
+static inline void tracking_shm_write (tracking_shm_header* header, const tracking_shm_record* record)
+{
+    const uint64_t index = __atomic_load_n (&header->writeIndex, __ATOMIC_RELAXED);
+    tracking_shm_record* slot = tracking_shm_records (header) + (index & (header->capacity - 1));
+
+    __atomic_store_n (&slot->sequence, 2 * index + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    slot->writeTimeNs = record->writeTimeNs;
+    slot->captureTime = record->captureTime;
+    slot->frame = record->frame;
+    slot->flags = record->flags;
+    slot->x = record->x;
+    slot->y = record->y;
+    slot->width = record->width;
+    slot->height = record->height;
+    __atomic_store_n (&slot->sequence, 2 * index + 2, __ATOMIC_RELEASE);
+    __atomic_store_n (&header->writeIndex, index + 1, __ATOMIC_RELEASE);
+}
+#endif
+
+#endif // TRACKINGSHAREDMEMORY_H
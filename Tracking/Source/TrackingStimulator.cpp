@@ -43,26 +43,21 @@ TrackingStimulator::TrackingStimulator()
     , m_positionDisplayedIsUpdated(false)
     , m_simulateTrajectory(false)
     , m_selectedCircle(-1)
-    , m_timePassed(0.0)
-    , m_currentTime(0.0)
-    , m_previousTime(0.0)
     , m_timePassed_sim(0.0)
     , m_currentTime_sim(0.0)
     , m_previousTime_sim(0.0)
     , m_count(0)
     , m_forward(true)
     , m_rad(0.0)
-    , m_outputChan(0)
-    , m_pulseDuration(DEF_DUR)
-    , m_ttlTriggered(false)
-    , m_stimFreq(DEF_FREQ)
-    , m_stimSD(DEF_SD)
-    , m_stimMode(uniform)
+    , m_rules(1)
+    , m_keypoint(-1)
 {
 
     setProcessorType (PROCESSOR_TYPE_FILTER);
 
     m_circles = std::vector<StimCircle>();
+    m_zoneHits.reserve (16);
+    updateZones();
 }
 
 TrackingStimulator::~TrackingStimulator()
@@ -102,6 +97,16 @@ float TrackingStimulator::getX(int s) const
         return -1;
 }
 
+int64 TrackingStimulator::getPositionAge(int s) const
+{
+    if (s < 0 || s >= sources.size() || sources[s].captureTime <= 0)
+        return -1;
+
+    const int64 now = std::chrono::duration_cast<std::chrono::microseconds> (
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    return now - sources[s].captureTime;
+}
+
 float TrackingStimulator::getY(int s) const
 {
     if (s < sources.size())
@@ -147,28 +152,164 @@ void TrackingStimulator::setSimulateTrajectory(bool sim)
 
 std::vector<StimCircle> TrackingStimulator::getCircles()
 {
+    const ScopedLock sl (lock);
     return m_circles;
 }
 
 void TrackingStimulator::addCircle(StimCircle c)
 {
-    m_circles.push_back(c);
+    {
+        const ScopedLock sl (lock);
+        m_circles.push_back(c);
+    }
+    updateZones();
 }
 
 void TrackingStimulator::editCircle(int ind, float x, float y, float rad, bool on)
 {
-    m_circles[ind].set(x,y,rad,on);
+    {
+        const ScopedLock sl (lock);
+        m_circles[ind].set(x,y,rad,on);
+    }
+    updateZones();
 }
 
 void TrackingStimulator::deleteCircle(int ind)
 {
-    m_circles.erase(m_circles.begin() + ind);
+    {
+        const ScopedLock sl (lock);
+        m_circles.erase(m_circles.begin() + ind);
+    }
+    updateZones();
 }
 
 void TrackingStimulator::disableCircles()
 {
-    for(int i=0; i<m_circles.size(); i++)
-        m_circles[i].off();
+    {
+        const ScopedLock sl (lock);
+        for(int i=0; i<m_circles.size(); i++)
+            m_circles[i].off();
+    }
+    updateZones();
+}
+
+int TrackingStimulator::getNumShapes() const
+{
+    return m_shapes.size();
+}
+
+StimArea* TrackingStimulator::getShape(int ind) const
+{
+    return m_shapes[ind];
+}
+
+void TrackingStimulator::addShape(StimArea* shape)
+{
+    {
+        const ScopedLock sl (lock);
+        m_shapes.add(shape);
+    }
+    updateZones();
+}
+
+void TrackingStimulator::clearShapes()
+{
+    {
+        const ScopedLock sl (lock);
+        m_shapes.clear();
+    }
+    updateZones();
+}
+
+void TrackingStimulator::updateZones()
+{
+    StimZoneIndex zoneIndex;
+    zoneIndex.build (m_circles, m_shapes);
+    updateRules (&zoneIndex);
+}
+
+void TrackingStimulator::updateRateMap()
+{
+    updateRules (nullptr);
+}
+
+void TrackingStimulator::updateRules(StimZoneIndex* zoneIndex)
+{
+    // Zones and rules only change on the message thread, so they are read here
+    // without the lock; it is only held to swap in the new index, zone masks
+    // and rate maps together, keeping process() from waiting on the rebuild
+    const StimZoneIndex& zones = zoneIndex != nullptr ? *zoneIndex : m_zoneIndex;
+    const int nZones = zones.getNumZones();
+
+    std::vector<std::vector<char>> zoneMasks (m_rules.size());
+    OwnedArray<StimRateMap> rateMaps;
+    for (int r = 0; r < m_rules.size(); r++)
+    {
+        const StimRule& rule = m_rules[r];
+        zoneMasks[r].assign (nZones, rule.zones.empty());
+        for (int i = 0; i < rule.zones.size(); i++)
+            if (rule.zones[i] >= 0 && rule.zones[i] < nZones)
+                zoneMasks[r][rule.zones[i]] = 1;
+
+        StimRateMap* rateMap = new StimRateMap();
+        rateMap->build (zones, zoneMasks[r], rule.mode, rule.freq, rule.sd);
+        rateMaps.add (rateMap);
+    }
+
+    const ScopedLock sl (lock);
+    if (zoneIndex != nullptr)
+        std::swap (m_zoneIndex, *zoneIndex);
+    for (int r = 0; r < m_rules.size(); r++)
+    {
+        std::swap (m_rules[r].zoneMask, zoneMasks[r]);
+        std::swap (m_rules[r].rateMap, *rateMaps[r]);
+    }
+}
+
+int TrackingStimulator::getNumRules() const
+{
+    const ScopedLock sl (lock);
+    return int(m_rules.size());
+}
+
+StimRule TrackingStimulator::getRule(int ind) const
+{
+    const ScopedLock sl (lock);
+    StimRule rule;
+    if (ind < 0 || ind >= m_rules.size())
+        return rule;
+
+    // The settings only: the evaluation state belongs to the rule table
+    const StimRule& current = m_rules[ind];
+    rule.source = current.source;
+    rule.zones = current.zones;
+    rule.mode = current.mode;
+    rule.freq = current.freq;
+    rule.sd = current.sd;
+    rule.duration = current.duration;
+    rule.outputChan = current.outputChan;
+    return rule;
+}
+
+void TrackingStimulator::addRule(const StimRule& rule)
+{
+    {
+        const ScopedLock sl (lock);
+        m_rules.push_back(rule);
+    }
+    updateRateMap();
+}
+
+void TrackingStimulator::removeRule(int ind)
+{
+    {
+        const ScopedLock sl (lock);
+        // rule 0 belongs to the canvas
+        if (ind <= 0 || ind >= m_rules.size())
+            return;
+        m_rules.erase(m_rules.begin() + ind);
+    }
+    updateRateMap();
 }
 
 int TrackingStimulator::getSelectedCircle() const
@@ -178,7 +319,13 @@ int TrackingStimulator::getSelectedCircle() const
 
 int TrackingStimulator::getSelectedSource() const
 {
-    return m_selectedSource;
+    const ScopedLock sl (lock);
+    return m_rules[0].source;
+}
+
+int TrackingStimulator::getKeypoint() const
+{
+    return m_keypoint;
 }
 
 void TrackingStimulator::setSelectedCircle(int ind)
@@ -188,58 +335,85 @@ void TrackingStimulator::setSelectedCircle(int ind)
 
 int TrackingStimulator::getOutputChan() const
 {
-    return m_outputChan;
+    const ScopedLock sl (lock);
+    return m_rules[0].outputChan;
 }
 
 float TrackingStimulator::getStimFreq() const
 {
-    return m_stimFreq;
+    const ScopedLock sl (lock);
+    return m_rules[0].freq;
 }
 float TrackingStimulator::getStimSD() const
 {
-    return m_stimSD;
+    const ScopedLock sl (lock);
+    return m_rules[0].sd;
 }
 stim_mode TrackingStimulator::getStimMode() const
 {
-    return m_stimMode;
+    const ScopedLock sl (lock);
+    return m_rules[0].mode;
 }
 int TrackingStimulator::getTtlDuration() const
 {
-    return m_pulseDuration;
+    const ScopedLock sl (lock);
+    return m_rules[0].duration;
 }
 
 void TrackingStimulator::setOutputChan(int chan)
 {
-    m_outputChan = chan;
+    const ScopedLock sl (lock);
+    m_rules[0].outputChan = chan;
 }
 
 void TrackingStimulator::setSelectedSource(int source)
 {
-    m_selectedSource = source;
+    const ScopedLock sl (lock);
+    m_rules[0].source = source;
+}
+
+void TrackingStimulator::setKeypoint(int keypoint)
+{
+    m_keypoint = keypoint;
 }
 
 void TrackingStimulator::setStimFreq(float stimFreq)
 {
-    m_stimFreq = stimFreq;
+    {
+        const ScopedLock sl (lock);
+        m_rules[0].freq = stimFreq;
+    }
+    updateRateMap();
 }
 void TrackingStimulator::setStimSD(float stimSD)
 {
-    m_stimSD = stimSD;
+    {
+        const ScopedLock sl (lock);
+        m_rules[0].sd = stimSD;
+    }
+    updateRateMap();
 }
 void TrackingStimulator::setTtlDuration(int dur)
 {
-    m_pulseDuration = dur;
+    const ScopedLock sl (lock);
+    m_rules[0].duration = dur;
 }
 
 
 void TrackingStimulator::setStimMode(stim_mode mode)
 {
-    m_stimMode = mode;
+    {
+        const ScopedLock sl (lock);
+        m_rules[0].mode = mode;
+    }
+    updateRateMap();
 }
 
 void TrackingStimulator::updateSettings()
 {
     sources.clear();
+    m_sourceTable.clear();
+    m_frameTable.clear();
     TrackingSources s;
     int nEvents = getTotalEventChannels();
 
@@ -256,8 +430,41 @@ void TrackingStimulator::updateSettings()
             s.y_pos = -1;
             s.width = -1;
             s.height = -1;
+            s.captureTime = 0;
+            // Keypoint channels declare the keypoints following the position
+            s.numKeypoints = 0;
+            s.keypointNames = String();
+            if (event->getMetaDataCount() >= 2)
+            {
+                event->getMetaDataValue(0)->getValue(s.numKeypoints);
+                event->getMetaDataValue(1)->getValue(s.keypointNames);
+            }
+            m_sourceTable[trackingSourceKey (s.sourceId, s.eventIndex)] = sources.size();
             sources.add (s);
         }
+        else if (event->getName().compare("Tracking frames") == 0)
+        {
+            // One entry per source of the frames, described by the channel metadata
+            int nSources = 0;
+            event->getMetaDataValue(0)->getValue(nSources);
+            m_frameTable[trackingSourceKey (event->getSourceNodeID(), event->getSourceIndex())]
+                = std::make_pair (sources.size(), nSources);
+            for (int k = 0; k < nSources; k++)
+            {
+                s.eventIndex = event->getSourceIndex();
+                s.sourceId =  event->getSourceNodeID();
+                s.name = "Tracking source " + String(k+1);
+                event->getMetaDataValue(1 + 3 * k)->getValue(s.color);
+                s.x_pos = -1;
+                s.y_pos = -1;
+                s.width = -1;
+                s.height = -1;
+                s.captureTime = 0;
+                s.numKeypoints = 0;
+                s.keypointNames = String();
+                sources.add (s);
+            }
+        }
     }
 }
 
@@ -266,6 +473,7 @@ void TrackingStimulator::process(AudioSampleBuffer&)
 {
     if (!m_simulateTrajectory)
     {
+        // Stimulation is decided in handleEvent(), as each position arrives
         checkForEvents();
     }
     else
@@ -302,132 +510,173 @@ void TrackingStimulator::process(AudioSampleBuffer&)
             m_timePassed_sim = 0;
             m_count++;
             m_positionIsUpdated = true;
+
+            // Simulated positions have no timestamp of their own: they are
+            // sampled at the start of the block. They drive the canvas rule only
+            if (m_isOn)
+            {
+                const ScopedLock sl (lock);
+                m_zoneIndex.query (m_x, m_y, m_zoneHits);
+                decideStimulation (m_rules[0], m_x, m_y, CoreServices::getGlobalTimestamp(), 0, CoreServices::getGlobalSampleRate());
+            }
         }
     }
+}
+
+void TrackingStimulator::evaluateRules (int source, float x, float y, int64 timestamp, int sampleOffset, float sampleRate)
+{
+    const ScopedLock sl (lock);
 
-    if (m_isOn)
+    // One zone lookup for the position, shared by every rule of the source
+    bool lookedUp = false;
+    for (int r = 0; r < m_rules.size(); r++)
     {
+        StimRule& rule = m_rules[r];
+        if (rule.source != source)
+            continue;
 
-        m_currentTime = Time::currentTimeMillis();
-        m_timePassed = float(m_currentTime - m_previousTime) / 1000.f; // in seconds
+        if (!lookedUp)
+        {
+            m_zoneIndex.query (x, y, m_zoneHits);
+            lookedUp = true;
+        }
+        decideStimulation (rule, x, y, timestamp, sampleOffset, sampleRate);
+    }
+}
 
-        lock.enter();
+void TrackingStimulator::decideStimulation (StimRule& rule, float x, float y, int64 timestamp, int sampleOffset, float sampleRate)
+{
+    // Time since the previous position, which the stimulation probability scales
+    // with; the first position of a stimulation run has none
+    float timePassed = rule.previousTimestamp >= 0 && sampleRate > 0
+                       ? float(timestamp - rule.previousTimestamp) / sampleRate // in seconds
+                       : 0.f;
+    rule.previousTimestamp = timestamp;
 
-        // Check if current position is within stimulation areas
-        bool stim = stimulate();
+    // Check if current position is within the stimulation areas of the rule; a
+    // rule just loaded has no zone mask until the zones are rebuilt
+    bool stim = false;
+    for (int i = 0; i < m_zoneHits.size() && !stim; i++)
+        stim = m_zoneHits[i].zone < rule.zoneMask.size() && rule.zoneMask[m_zoneHits[i].zone] != 0;
 
-        if (stim)
+    if (stim)
+    {
+        if (rule.mode == ttl)
         {
-            // Check if timePassed >= latency
-            if (m_stimMode == ttl)
+            if (!rule.ttlTriggered)
             {
-                if (!m_ttlTriggered)
-                {
-                    triggerEvent();
-                    m_ttlTriggered = true;
-                }
+                triggerEvent (rule, timestamp, sampleOffset);
+                rule.ttlTriggered = true;
             }
-            else
-            {
-                float stim_interval;
-                if (m_stimMode == uniform)  {
-                    stim_interval = float(1.f / m_stimFreq);
-                }
-                else if (m_stimMode == gauss)                     //gaussian
-                {
-                    int circleIn = isPositionWithinCircles(m_x, m_y);
-                    float dist_norm = m_circles[circleIn].distanceFromCenter(m_x, m_y) / m_circles[circleIn].getRad();
-                    float k = -1.0 / std::log(m_stimSD);
-                    float freq_gauss = m_stimFreq*std::exp(-pow(dist_norm,2)/k);
-                    stim_interval = float(1/freq_gauss);
-                }
-
-                float stimulationProbability = m_timePassed / stim_interval;
-                std::uniform_real_distribution<float> distribution(0.0, 1.0);
-                float randomNumber = distribution(generator);
+        }
+        else
+        {
+            // Uniform or gaussian rate, precomputed in the rate map
+            float stimulationProbability = timePassed * rule.rateMap.rateAt(x, y);
+            std::uniform_real_distribution<float> distribution(0.0, 1.0);
+            float randomNumber = distribution(generator);
 
-                if (stimulationProbability > 1)
-                    std::cout << "WARNING: The tracking stimulation frequency is higher than the sampling frequency." << std::endl;
+            // Reported once acquisition stops, never from the audio thread
+            if (stimulationProbability > 1)
+                m_saturatedDecisions.fetch_add(1, std::memory_order_relaxed);
 
-                if (randomNumber < stimulationProbability)
-                {
-                    triggerEvent();
-                }
+            if (randomNumber < stimulationProbability)
+            {
+                triggerEvent (rule, timestamp, sampleOffset);
             }
-
         }
-        else
-            m_ttlTriggered = false;
-        m_previousTime = m_currentTime;
 
-        lock.exit();
     }
+    else
+        rule.ttlTriggered = false;
+}
+
+bool TrackingStimulator::disable()
+{
+    const uint64 saturated = m_saturatedDecisions.exchange(0);
+    if (saturated > 0)
+        std::cout << "WARNING: The tracking stimulation frequency was higher than the rate of the positions ("
+                  << saturated << " positions)." << std::endl;
+    return true;
 }
 
-void TrackingStimulator::triggerEvent()
+void TrackingStimulator::triggerEvent (const StimRule& rule, int64 timestamp, int sampleOffset)
 {
-    int64 timestamp = CoreServices::getGlobalTimestamp();
-    setTimestampAndSamples(timestamp, 0);
-    uint8 ttlData = 1 << m_outputChan;
+    uint8 ttlData = 1 << rule.outputChan;
     const EventChannel* chan = getEventChannel(getEventChannelIndex(0, getNodeId()));
 
-    // Send ON event
-    TTLEventPtr event = TTLEvent::createTTLEvent(chan, timestamp, &ttlData, sizeof(uint8), m_outputChan);
-    addEvent(chan, event, 0);
+    // Send ON event, at the sample of the position that triggered it
+    TTLEventPtr event = TTLEvent::createTTLEvent(chan, timestamp, &ttlData, sizeof(uint8), rule.outputChan);
+    addEvent(chan, event, sampleOffset);
 
-    int eventDurationSamp = static_cast<int>(ceil(m_pulseDuration / 1000.0f * getSampleRate()));
+    int eventDurationSamp = static_cast<int>(ceil(rule.duration / 1000.0f * getSampleRate()));
     uint8 ttlDataOff = 0;
-    TTLEventPtr eventOff = TTLEvent::createTTLEvent(chan, timestamp + eventDurationSamp, &ttlDataOff, sizeof(uint8), m_outputChan);
-    addEvent(chan, eventOff, 0);
+    TTLEventPtr eventOff = TTLEvent::createTTLEvent(chan, timestamp + eventDurationSamp, &ttlDataOff, sizeof(uint8), rule.outputChan);
+    addEvent(chan, eventOff, sampleOffset);
 }
 
-void TrackingStimulator::handleEvent (const EventChannel* eventInfo, const MidiMessage& event, int)
+void TrackingStimulator::handleEvent (const EventChannel* eventInfo, const MidiMessage& event, int samplePosition)
 {
-    if ((eventInfo->getName()).compare("Tracking data") != 0)
+    // Decided as the positions arrive, at their sample rather than once per block
+    const int64 timestamp = Event::getTimestamp (event);
+    const float sampleRate = eventInfo->getSampleRate();
+
+    // Only tracking channels are in the tables, so this also filters other events
+    const uint64 key = trackingSourceKey (eventInfo->getSourceNodeID(), eventInfo->getSourceIndex());
+    TrackingSourceTable::const_iterator entry = m_sourceTable.find (key);
+    if (entry != m_sourceTable.end())
     {
-        return;
-    }
+        BinaryEventPtr evtptr = BinaryEvent::deserializeFromMessage(event, eventInfo);
 
-    BinaryEventPtr evtptr = BinaryEvent::deserializeFromMessage(event, eventInfo);
+        TrackingSources& currentSource = sources.getReference (entry->second);
+        applyTrackingPosition (currentSource, readTrackingPosition (evtptr->getBinaryDataPointer(),
+                                                                    currentSource.numKeypoints, m_keypoint));
 
-    int nodeId = evtptr->getSourceID();
-    int evtId = evtptr->getSourceIndex();
-    const auto *position = reinterpret_cast<const TrackingPosition *>(evtptr->getBinaryDataPointer());
+        String sourceColor;
+        evtptr->getMetaDataValue(0)->getValue(sourceColor);
+        evtptr->getMetaDataValue(3)->getValue(currentSource.captureTime);
 
-    int nSources = sources.size ();
+        if (currentSource.color.compare(sourceColor) != 0)
+        {
+            currentSource.color = sourceColor;
+        }
 
-    for (int i = 0; i < nSources; i++)
+        if (m_isOn)
+            evaluateRules (entry->second, currentSource.x_pos, currentSource.y_pos,
+                           timestamp, samplePosition, sampleRate);
+    }
+    else
     {
-        TrackingSources& currentSource = sources.getReference (i);
-        if (currentSource.sourceId == nodeId && evtId == currentSource.eventIndex)
+        TrackingFrameTable::const_iterator frameEntry = m_frameTable.find (key);
+        if (frameEntry == m_frameTable.end())
         {
-            if(!(position->x != position->x || position->y != position->y) && position->x != 0 && position->y != 0)
-            {
-                currentSource.x_pos = position->x;
-                currentSource.y_pos = position->y;
-            }
-            if(!(position->width != position->width || position->height != position->height))
-            {
-                currentSource.width = position->width;
-                currentSource.height = position->height;
-            }
+            return;
+        }
 
-            String sourceColor;
-            evtptr->getMetaDataValue(0)->getValue(sourceColor);
+        BinaryEventPtr evtptr = BinaryEvent::deserializeFromMessage(event, eventInfo);
 
-            if (currentSource.color.compare(sourceColor) != 0)
+        const auto *frame = reinterpret_cast<const TrackingFrame *>(evtptr->getBinaryDataPointer());
+        for (int k = 0; k < frameEntry->second.second; k++)
+        {
+            if (frame->validMask & (1u << k))
             {
-                currentSource.color = sourceColor;
-
+                TrackingSources& currentSource = sources.getReference (frameEntry->second.first + k);
+                applyTrackingPosition (currentSource, frame->positions[k]);
+                currentSource.captureTime = frame->captureTime;
+                if (m_isOn)
+                    evaluateRules (frameEntry->second.first + k, currentSource.x_pos, currentSource.y_pos,
+                                   timestamp, samplePosition, sampleRate);
             }
         }
     }
-    if (m_selectedSource != -1)
+
+    const int selectedSource = getSelectedSource();
+    if (selectedSource != -1)
     {
-        m_x = sources.getReference (m_selectedSource).x_pos;
-        m_y = sources.getReference (m_selectedSource).y_pos;
-        m_width = sources.getReference (m_selectedSource).width;
-        m_height = sources.getReference (m_selectedSource).height;
+        m_x = sources.getReference (selectedSource).x_pos;
+        m_y = sources.getReference (selectedSource).y_pos;
+        m_width = sources.getReference (selectedSource).width;
+        m_height = sources.getReference (selectedSource).height;
         m_aspect_ratio = m_width / m_height;
     }
     else
@@ -442,23 +691,21 @@ void TrackingStimulator::handleEvent (const EventChannel* eventInfo, const MidiM
 
 int TrackingStimulator::isPositionWithinCircles(float x, float y)
 {
-    int whichCircle = -1;
-    for (int i = 0; i < m_circles.size() && whichCircle == -1; i++)
-    {
-        if (m_circles[i].isPositionIn(x,y))
-            whichCircle = i;
-    }
-    return whichCircle;
+    const ScopedLock sl (lock);
+    // circles are the first zones, so the first zone is a circle if any is hit
+    int zone = m_zoneIndex.first (x, y);
+    return zone < m_circles.size() ? zone : -1;
 }
 
-bool TrackingStimulator::stimulate()
+bool TrackingStimulator::isPositionWithinActiveZone(float x, float y)
 {
-    if (isPositionWithinCircles(m_x, m_y) != -1)
-    {
-        return true;
-    }
-    else
-        return false;
+    const ScopedLock sl (lock);
+    std::vector<StimZoneHit> hits;
+    m_zoneIndex.query (x, y, hits);
+    for (int i = 0; i < hits.size(); i++)
+        if (m_zoneIndex.getZoneOn (hits[i].zone))
+            return true;
+    return false;
 }
 
 bool TrackingStimulator::positionDisplayedIsUpdated() const
@@ -490,6 +737,12 @@ void TrackingStimulator::setColorIsUpdated(bool up)
 
 void TrackingStimulator::startStimulation()
 {
+    const ScopedLock sl (lock);
+    for (int r = 0; r < m_rules.size(); r++)
+    {
+        m_rules[r].previousTimestamp = -1;
+        m_rules[r].ttlTriggered = false;
+    }
     m_isOn = true;
 
 }
@@ -499,6 +752,141 @@ void TrackingStimulator::stopStimulation()
     m_isOn = false;
 }
 
+XmlElement* TrackingStimulator::saveRulesXml()
+{
+    // rule 0 is saved with the canvas settings
+    XmlElement* rules = new XmlElement("RULES");
+    for (int r=1; r<m_rules.size(); r++)
+    {
+        const StimRule& rule = m_rules[r];
+        XmlElement* rl = rules->createNewChildElement("RULE");
+        rl->setAttribute("id", r);
+        rl->setAttribute("source", rule.source);
+        rl->setAttribute("output", rule.outputChan);
+        rl->setAttribute("stim-mode", rule.mode);
+        rl->setAttribute("freq", rule.freq);
+        rl->setAttribute("sd", rule.sd);
+        rl->setAttribute("duration", rule.duration);
+
+        String zones;
+        for (int i=0; i<rule.zones.size(); i++)
+            zones += (i > 0 ? " " : "") + String(rule.zones[i]);
+        rl->setAttribute("zones", zones);
+    }
+    return rules;
+}
+
+static stim_mode toStimMode(int mode)
+{
+    // Unknown modes, e.g. from a newer version, fall back to the default
+    return mode >= uniform && mode <= ttl ? (stim_mode) mode : uniform;
+}
+
+void TrackingStimulator::loadRulesXml(XmlElement* element)
+{
+    // Read first, then appended to the rules: process() evaluates them under the
+    // lock. The loaders drop the previous extra rules before they get here, and the
+    // zone masks and rate maps are built by the updateZones() that follows.
+    std::vector<StimRule> rules;
+    forEachXmlChildElementWithTagName(*element, element2, "RULE")
+    {
+        StimRule rule;
+        rule.source = element2->getIntAttribute("source", -1);
+        rule.outputChan = jlimit(0, 7, element2->getIntAttribute("output"));
+        rule.mode = toStimMode(element2->getIntAttribute("stim-mode"));
+        rule.freq = element2->getDoubleAttribute("freq", DEF_FREQ);
+        rule.sd = element2->getDoubleAttribute("sd", DEF_SD);
+        rule.duration = element2->getIntAttribute("duration", DEF_DUR);
+
+        // zone numbers separated by spaces, circles first then shapes; none for all zones
+        StringArray zones;
+        zones.addTokens(element2->getStringAttribute("zones"), " ", "");
+        for (int i=0; i<zones.size(); i++)
+            if (zones[i].isNotEmpty())
+                rule.zones.push_back(zones[i].getIntValue());
+
+        rules.push_back(rule);
+    }
+
+    const ScopedLock sl (lock);
+    for (int r = 0; r < rules.size(); r++)
+        m_rules.push_back(std::move(rules[r]));
+}
+
+XmlElement* TrackingStimulator::saveShapesXml()
+{
+    XmlElement* shapes = new XmlElement("SHAPES");
+    for (int i=0; i<m_shapes.size(); i++)
+    {
+        StimArea* shape = m_shapes[i];
+        XmlElement* shp = new XmlElement(shape->returnType().toUpperCase());
+        shp->setAttribute("id", i);
+        shp->setAttribute("xpos", shape->getX());
+        shp->setAttribute("ypos", shape->getY());
+        shp->setAttribute("on", shape->getOn());
+
+        if (StimRect* rect = dynamic_cast<StimRect*>(shape))
+        {
+            shp->setAttribute("width", rect->getW());
+            shp->setAttribute("height", rect->getH());
+        }
+        else if (StimEllipse* ellipse = dynamic_cast<StimEllipse*>(shape))
+        {
+            shp->setAttribute("xrad", ellipse->getRx());
+            shp->setAttribute("yrad", ellipse->getRy());
+        }
+        else if (StimPolygon* polygon = dynamic_cast<StimPolygon*>(shape))
+        {
+            for (int v=0; v<polygon->getNumVertices(); v++)
+            {
+                XmlElement* vertex = shp->createNewChildElement("VERTEX");
+                vertex->setAttribute("xpos", polygon->getVertexX(v));
+                vertex->setAttribute("ypos", polygon->getVertexY(v));
+            }
+        }
+        shapes->addChildElement(shp);
+    }
+    return shapes;
+}
+
+void TrackingStimulator::loadShapesXml(XmlElement* element)
+{
+    m_shapes.clear();
+    forEachXmlChildElement(*element, element2)
+    {
+        double cx = element2->getDoubleAttribute("xpos");
+        double cy = element2->getDoubleAttribute("ypos");
+        bool on = element2->getIntAttribute("on");
+
+        if (element2->hasTagName("RECT"))
+        {
+            double w = element2->getDoubleAttribute("width");
+            double h = element2->getDoubleAttribute("height");
+            m_shapes.add(new StimRect((float) cx, (float) cy, (float) w, (float) h, on));
+        }
+        else if (element2->hasTagName("ELLIPSE"))
+        {
+            double rx = element2->getDoubleAttribute("xrad");
+            double ry = element2->getDoubleAttribute("yrad");
+            m_shapes.add(new StimEllipse((float) cx, (float) cy, (float) rx, (float) ry, on));
+        }
+        else if (element2->hasTagName("POLYGON"))
+        {
+            std::vector<float> xs;
+            std::vector<float> ys;
+            forEachXmlChildElementWithTagName(*element2, vertex, "VERTEX")
+            {
+                xs.push_back((float) vertex->getDoubleAttribute("xpos"));
+                ys.push_back((float) vertex->getDoubleAttribute("ypos"));
+            }
+            if (xs.size() >= 3)
+                m_shapes.add(new StimPolygon(xs, ys, on));
+            else
+                std::cout << "Ignoring polygon with less than 3 vertices." << std::endl;
+        }
+    }
+}
+
 bool TrackingStimulator::saveParametersXml()
 {
     //Save
@@ -520,13 +908,15 @@ bool TrackingStimulator::saveParametersXml()
     // save stimulator conf
     XmlElement* stim = new XmlElement("STIMULATION");
 
-    stim->setAttribute("freq", m_stimFreq);
-    stim->setAttribute("sd", m_stimSD);
-    stim->setAttribute("stim-mode", m_stimMode);
-    stim->setAttribute("duration", m_pulseDuration);
+    stim->setAttribute("freq", getStimFreq());
+    stim->setAttribute("sd", getStimSD());
+    stim->setAttribute("stim-mode", getStimMode());
+    stim->setAttribute("duration", getTtlDuration());
 
     state->addChildElement(circles);
+    state->addChildElement(saveShapesXml());
     state->addChildElement(stim);
+    state->addChildElement(saveRulesXml());
 
     if (! state->writeToFile(currentConfigFile, String::empty))
         return false;
@@ -550,33 +940,44 @@ bool TrackingStimulator::loadParametersXml(File fileToLoad)
     }
     else
     {
-
-        forEachXmlChildElement(*xml, element)
         {
-            if (element->hasTagName("CIRCLES"))
+            const ScopedLock sl (lock);
+
+            // Only rule 0 is kept from the previous session, also for configs
+            // saved before there were RULES
+            m_rules.resize(1);
+            forEachXmlChildElement(*xml, element)
             {
-                m_circles.clear();
-                forEachXmlChildElement(*element, element2)
+                if (element->hasTagName("CIRCLES"))
                 {
-                    int id = element2->getIntAttribute("id");
-                    double cx = element2->getDoubleAttribute("xpos");
-                    double cy = element2->getDoubleAttribute("ypos");
-                    double crad = element2->getDoubleAttribute("rad");
-                    bool on = element2->getIntAttribute("on");
+                    m_circles.clear();
+                    forEachXmlChildElement(*element, element2)
+                    {
+                        int id = element2->getIntAttribute("id");
+                        double cx = element2->getDoubleAttribute("xpos");
+                        double cy = element2->getDoubleAttribute("ypos");
+                        double crad = element2->getDoubleAttribute("rad");
+                        bool on = element2->getIntAttribute("on");
 
-                    StimCircle newCircle = StimCircle((float) cx, (float) cy, (float) crad, on);
-                    m_circles.push_back(newCircle);
+                        StimCircle newCircle = StimCircle((float) cx, (float) cy, (float) crad, on);
+                        m_circles.push_back(newCircle);
 
+                    }
                 }
-            }
-            if (element->hasTagName("STIMULATION"))
-            {
-                m_stimFreq = element->getDoubleAttribute("freq");
-                m_stimSD = element->getDoubleAttribute("sd");
-                m_stimMode = (stim_mode) element->getIntAttribute("stim-mode");
-                m_pulseDuration = element->getIntAttribute("duration");
+                if (element->hasTagName("SHAPES"))
+                    loadShapesXml(element);
+                if (element->hasTagName("STIMULATION"))
+                {
+                    m_rules[0].freq = element->getDoubleAttribute("freq");
+                    m_rules[0].sd = element->getDoubleAttribute("sd");
+                    m_rules[0].mode = toStimMode(element->getIntAttribute("stim-mode"));
+                    m_rules[0].duration = element->getIntAttribute("duration");
+                }
+                if (element->hasTagName("RULES"))
+                    loadRulesXml(element);
             }
         }
+        updateZones();
         return true;
     }
 }
@@ -647,8 +1048,9 @@ void TrackingStimulator::saveCustomParametersToXml(XmlElement *parentElement)
 {
     //Save
     XmlElement* state = parentElement->createNewChildElement("TrackingStimulator");
-    state->setAttribute("Source", m_selectedSource);
-    state->setAttribute("Output", m_outputChan);
+    state->setAttribute("Source", getSelectedSource());
+    state->setAttribute("Output", getOutputChan());
+    state->setAttribute("Keypoint", m_keypoint);
 
     // save circles
     XmlElement* circles = new XmlElement("CIRCLES");
@@ -666,13 +1068,15 @@ void TrackingStimulator::saveCustomParametersToXml(XmlElement *parentElement)
     // save stimulator conf
     XmlElement* stim = new XmlElement("STIMULATION");
 
-    stim->setAttribute("freq", m_stimFreq);
-    stim->setAttribute("sd", m_stimSD);
-    stim->setAttribute("stim-mode", m_stimMode);
-    stim->setAttribute("duration", m_pulseDuration);
+    stim->setAttribute("freq", getStimFreq());
+    stim->setAttribute("sd", getStimSD());
+    stim->setAttribute("stim-mode", getStimMode());
+    stim->setAttribute("duration", getTtlDuration());
 
     state->addChildElement(circles);
+    state->addChildElement(saveShapesXml());
     state->addChildElement(stim);
+    state->addChildElement(saveRulesXml());
 }
 
 void TrackingStimulator::loadCustomParametersFromXml()
@@ -683,190 +1087,59 @@ void TrackingStimulator::loadCustomParametersFromXml()
         {
             if (mainNode->hasTagName("TrackingStimulator"))
             {
-                m_selectedSource = mainNode->getIntAttribute("Source");
-                m_outputChan = mainNode->getIntAttribute("Output");
-                forEachXmlChildElement(*mainNode, element)
                 {
-                    if (element->hasTagName("CIRCLES"))
+                    const ScopedLock sl (lock);
+                    m_rules[0].source = mainNode->getIntAttribute("Source");
+                    m_rules[0].outputChan = mainNode->getIntAttribute("Output");
+                    m_keypoint = mainNode->getIntAttribute("Keypoint", -1);
+                    m_rules.resize(1);
+                    forEachXmlChildElement(*mainNode, element)
                     {
-                        m_circles.clear();
-                        forEachXmlChildElement(*element, element2)
+                        if (element->hasTagName("CIRCLES"))
                         {
-                            int id = element2->getIntAttribute("id");
-                            double cx = element2->getDoubleAttribute("xpos");
-                            double cy = element2->getDoubleAttribute("ypos");
-                            double crad = element2->getDoubleAttribute("rad");
-                            bool on = element2->getIntAttribute("on");
-
-                            StimCircle newCircle = StimCircle((float) cx, (float) cy, (float) crad, on);
-                            m_circles.push_back(newCircle);
-
+                            m_circles.clear();
+                            forEachXmlChildElement(*element, element2)
+                            {
+                                int id = element2->getIntAttribute("id");
+                                double cx = element2->getDoubleAttribute("xpos");
+                                double cy = element2->getDoubleAttribute("ypos");
+                                double crad = element2->getDoubleAttribute("rad");
+                                bool on = element2->getIntAttribute("on");
+
+                                StimCircle newCircle = StimCircle((float) cx, (float) cy, (float) crad, on);
+                                m_circles.push_back(newCircle);
+
+                            }
                         }
-                    }
-                    if (element->hasTagName("STIMULATION"))
-                    {
-                        m_stimFreq = element->getDoubleAttribute("freq");
-                        m_stimSD = element->getDoubleAttribute("sd");
-                        m_stimMode = (stim_mode) element->getIntAttribute("stim-mode");
-                        m_pulseDuration = element->getIntAttribute("duration");
+                        if (element->hasTagName("SHAPES"))
+                            loadShapesXml(element);
+                        if (element->hasTagName("STIMULATION"))
+                        {
+                            m_rules[0].freq = element->getDoubleAttribute("freq");
+                            m_rules[0].sd = element->getDoubleAttribute("sd");
+                            m_rules[0].mode = toStimMode(element->getIntAttribute("stim-mode"));
+                            m_rules[0].duration = element->getIntAttribute("duration");
+                        }
+                        if (element->hasTagName("RULES"))
+                            loadRulesXml(element);
                     }
                 }
+                updateZones();
             }
         }
     }
 }
 
-// StimArea methods
-
-
-StimArea::StimArea() :
-    m_cx(0),
-    m_cy(0),
-    m_on(false)
-{
-}
-
-StimArea::StimArea(float x, float y, bool on) :
-    m_cx(x),
-    m_cy(y),
-    m_on(on)
-{
-}
-
-float StimArea::getX()
-{
-    return m_cx;
-}
-float StimArea::getY()
-{
-    return m_cy;
-}
-bool StimArea::getOn()
-{
-    return m_on;
-}
-
-void StimArea::setX(float x)
-{
-    m_cx = x;
-}
-void StimArea::setY(float y)
-{
-    m_cy = y;
-}
-
-bool StimArea::on()
-{
-    m_on = true;
-    return m_on;
-}
-bool StimArea::off()
-{
-    m_on = false;
-    return m_on;
-}
-
-// Circle methods
-
-StimCircle::StimCircle()
-    : m_rad(0), StimArea(0, 0, false)
-{
-}
-
-StimCircle::StimCircle(float x, float y, float rad, bool on) : StimArea(x, y, on)
-{
-    m_rad = rad;
-}
-
-float StimCircle::getRad()
-{
-    return m_rad;
-}
+// Rule methods
 
-void StimCircle::setRad(float rad)
+StimRule::StimRule()
+    : source(-1)
+    , mode(uniform)
+    , freq(DEF_FREQ)
+    , sd(DEF_SD)
+    , duration(DEF_DUR)
+    , outputChan(0)
+    , previousTimestamp(-1)
+    , ttlTriggered(false)
 {
-    m_rad = rad;
 }
-void StimCircle::set(float x, float y, float rad, bool on)
-{
-    m_cx = x;
-    m_cy = y;
-    m_rad = rad;
-    m_on = on;
-}
-
-bool StimCircle::isPositionIn(float x, float y)
-{
-    if (pow(x - m_cx,2) + pow(y - m_cy,2)
-            <= m_rad*m_rad)
-        return true;
-    else
-        return false;
-}
-
-float StimCircle::distanceFromCenter(float x, float y){
-    return sqrt(pow(x - m_cx,2) + pow(y - m_cy,2));
-}
-
-String StimCircle::returnType()
-{
-    return String("circle");
-}
-
-// Rect methods
-
-StimRect::StimRect()
-    : m_w(0), m_h(0), StimArea(0, 0, false)
-{
-}
-
-StimRect::StimRect(float x, float y, float w, float h, bool on) : StimArea(x, y, on)
-{
-    m_w = w;
-    m_h = h;
-}
-
-float StimRect::getW()
-{
-    return m_w;
-}
-float StimRect::getH()
-{
-    return m_h;
-}
-
-void StimRect::setW(float w)
-{
-    m_w = w;
-}
-void StimRect::setH(float h)
-{
-    m_h = h;
-}
-void StimRect::set(float x, float y, float w, float h, bool on)
-{
-    m_cx = x;
-    m_cy = y;
-    m_w = w;
-    m_h = h;
-    m_on = on;
-}
-
-bool StimRect::isPositionIn(float x, float y)
-{
-    if ((std::abs(x - m_cx) < m_w / 2.0) && (std::abs(y - m_cy) < m_h / 2.0))
-        return true;
-    else
-        return false;
-}
-
-float StimRect::distanceFromCenter(float x, float y){
-    return std::abs(x - m_cx) + std::abs(y - m_cy);
-}
-
-String StimRect::returnType()
-{
-    return String("rect");
-}
-
-
@@ -35,7 +35,10 @@
 #include <ProcessorHeaders.h>
 #include "TrackingStimulatorEditor.h"
 #include "TrackingMessage.h"
+#include "TrackingStimulatorZones.h"
 
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <random>
 
@@ -51,98 +54,33 @@
 
 #define TRACKING_FREQ 20
 
-#define MAX_CIRCLES 9
-
-/**
-
-  Class for Abstrac Stimulation Area
-
-*/
-class StimArea
-{
-public:
-    StimArea();
-    StimArea(float x, float y, bool on);
-
-    float getX();
-    float getY();
-    bool getOn();
-    void setX(float x);
-    void setY(float y);
-
-    bool on();
-    bool off();
-
-    virtual bool isPositionIn(float x, float y) = 0;
-    virtual float distanceFromCenter(float x, float y) = 0;
-    virtual String returnType() = 0;
-
-protected:
-
-    float m_cx;
-    float m_cy;
-    bool m_on;
-
-};
-/**
-
-  Class for Stimulation Circles
-
-*/
-class StimCircle : public StimArea
-{
-public:
-    StimCircle();
-    StimCircle(float x, float y, float r, bool on);
-
-    float getRad();
-
-    void setRad(float rad);
-    void set(float x, float y, float rad, bool on);
-
-    bool isPositionIn(float x, float y);
-    float distanceFromCenter(float x, float y);
-    String returnType();
-
-private:
-    float m_rad;
-};
-
 /**
 
-  Class for Stimulation Rectangle
+  Closed-loop rule: positions of a source inside any zone of the rule pulse
+  its output line, with the stimulation mode and parameters of the rule.
+  Rule 0 is the one set up in the canvas.
 
 */
-class StimRect : public StimArea
+struct StimRule
 {
-public:
-    StimRect();
-    StimRect(float x, float y, float w, float h, bool on);
-
-    float getW();
-    float getH();
-
-    void setW(float w);
-    void setH(float h);
-    void set(float x, float y, float w, float h, bool on);
-
-    bool isPositionIn(float x, float y) override;
-    float distanceFromCenter(float x, float y) override;
-    String returnType() override;
-
-private:
-    float m_w;
-    float m_h;
+    StimRule();
+
+    int source;
+    /** Zones of the rule, numbered as in StimZoneIndex; empty for all zones */
+    std::vector<int> zones;
+    stim_mode mode;
+    float freq;
+    float sd;
+    int duration;
+    int outputChan;
+
+    // Evaluation state, on the sample clock of the positions
+    int64 previousTimestamp;
+    bool ttlTriggered;
+    std::vector<char> zoneMask;
+    StimRateMap rateMap;
 };
 
-
-typedef enum
-{
-  uniform,
-  gauss,
-  ttl
-} stim_mode;
-
 /**
 
     Select stimulation regions for closed-loop tracking stimulation.
@@ -160,6 +98,7 @@ public:
     AudioProcessorEditor* createEditor();
 
     void process(AudioSampleBuffer& buffer) override;
+    bool disable() override;
     void handleEvent (const EventChannel* eventInfo, const MidiMessage& event, int) override;
     void saveCustomParametersToXml(XmlElement* parentElement) override;
     void loadCustomParametersFromXml() override;
@@ -175,6 +114,9 @@ public:
     float getSimY() const;
     float getWidth(int s) const;
     float getHeight(int s) const;
+    /** Microseconds since the sender captured the last position of source s, on the
+        wall clock; -1 if the source does not send capture times. */
+    int64 getPositionAge(int s) const;
 
     int getNSources() const;
     TrackingSources& getTrackingSource(int s) const;
@@ -184,6 +126,12 @@ public:
     void editCircle(int ind, float x, float y, float rad, bool on);
     void deleteCircle(int ind);
     void disableCircles();
+    /** Rectangles, ellipses and polygons, stimulating like the circles; they are
+        loaded from the configuration and not edited in the canvas */
+    int getNumShapes() const;
+    StimArea* getShape(int ind) const;
+    void addShape(StimArea* shape);
+    void clearShapes();
     // Circle setter can be done using Cicle class public methods
     int getSelectedCircle() const;
     void setSelectedCircle(int ind);
@@ -191,6 +139,8 @@ public:
     bool getSimulateTrajectory() const;
     int getOutputChan() const;
     int getSelectedSource() const;
+    /** Keypoint of the sources tracked instead of their position, -1 for the position */
+    int getKeypoint() const;
 
     float getStimFreq() const;
     float getStimSD() const;
@@ -201,6 +151,7 @@ public:
     void setSimulateTrajectory(bool sim);
     void setOutputChan(int chan);
     void setSelectedSource(int source);
+    void setKeypoint(int keypoint);
 
     void setStimFreq(float stimFreq);
     void setStimSD(float stimSD);
@@ -208,12 +159,21 @@ public:
     void setStimMode(stim_mode mode);
     void setTtlDuration(int dur);
 
+    /** Rules beyond rule 0, e.g. one per animal and laser, are set up in the
+        configuration */
+    int getNumRules() const;
+    /** A copy of the settings of rule ind */
+    StimRule getRule(int ind) const;
+    void addRule(const StimRule& rule);
+    void removeRule(int ind);
+
     void clearPositionDisplayedUpdated();
     bool positionDisplayedIsUpdated() const;
     bool getColorIsUpdated() const;
     void setColorIsUpdated(bool up);
 
     int isPositionWithinCircles(float x, float y);
+    bool isPositionWithinActiveZone(float x, float y);
 
     void save();
     void saveAs();
@@ -226,17 +186,15 @@ private:
 
     CriticalSection lock;
     Array<TrackingSources> sources;
+    TrackingSourceTable m_sourceTable;
+    TrackingFrameTable m_frameTable;
 
     // OnOff
     bool m_isOn;
 
-    // Time stim
-    float m_timePassed;
-    int64 m_previousTime;
-    int64 m_currentTime;
-    bool m_ttlTriggered;
-
     std::default_random_engine generator;
+    // Positions whose stimulation probability exceeded 1, counted by the audio thread
+    std::atomic<uint64> m_saturatedDecisions {0};
 
 
     // Time sim position
@@ -262,24 +220,32 @@ private:
 
     std::vector<StimCircle> m_circles;
     int m_selectedCircle;
+    OwnedArray<StimArea> m_shapes;
+    StimZoneIndex m_zoneIndex;
+    // Zones containing the last decided position
+    std::vector<StimZoneHit> m_zoneHits;
 
-    // Stimulation params
-    float m_stimFreq;
-    float m_stimSD;
-//    int m_isUniform;
-    stim_mode m_stimMode;
-    int m_pulseDuration;
-
-    // Selected stimulation chan
-    int m_outputChan;
-    int m_selectedSource;
+    // Stimulation rules, never empty
+    std::vector<StimRule> m_rules;
+    int m_keypoint;
 
     File currentConfigFile;
 
     // Stimulate decision
-    bool stimulate();
-    void triggerEvent();
-
+    void updateZones();
+    void updateRateMap();
+    void updateRules (StimZoneIndex* zoneIndex);
+    /** Evaluates the rules of a source for its position, sampled at the given
+        timestamp, in one zone lookup; pulses start at that sample */
+    void evaluateRules (int source, float x, float y, int64 timestamp, int sampleOffset, float sampleRate);
+    /** Decides whether the position, looked up in m_zoneHits, triggers a pulse of the rule */
+    void decideStimulation (StimRule& rule, float x, float y, int64 timestamp, int sampleOffset, float sampleRate);
+    void triggerEvent (const StimRule& rule, int64 timestamp, int sampleOffset);
+
+    XmlElement* saveShapesXml();
+    void loadShapesXml(XmlElement* element);
+    XmlElement* saveRulesXml();
+    void loadRulesXml(XmlElement* element);
     bool saveParametersXml();
     bool loadParametersXml(File loadFile);
 
@@ -147,15 +147,7 @@ void TrackingStimulatorCanvas::resized()
 
     onButton->setBounds(getWidth() - 0.065*getWidth(), 0.46*getHeight(), 0.03*getWidth(),0.03*getHeight());
 
-    for (int i = 0; i<MAX_CIRCLES; i++)
-    {
-        circlesButton[i]->setBounds(getWidth() - 0.2*getWidth()+i*(0.18/MAX_CIRCLES)*getWidth(), 0.5*getHeight(),
-                                    (0.18/MAX_CIRCLES)*getWidth(),0.03*getHeight());
-        if (i<processor->getCircles().size())
-            circlesButton[i]->setVisible(true);
-        else
-            circlesButton[i]->setVisible(false);
-    }
+    uploadCircles();
 
     uniformButton->setBounds(getWidth() - 0.2*getWidth(), 0.65*getHeight(), 0.06*getWidth(),0.03*getHeight());
     gaussianButton->setBounds(getWidth() - 0.2*getWidth() + 0.06*getWidth(), 0.65*getHeight(), 0.06*getWidth(),0.03*getHeight());
@@ -163,6 +155,7 @@ void TrackingStimulatorCanvas::resized()
 
     availableChans->setBounds(getWidth() - 0.2*getWidth(), 0.05*getHeight(), 0.18*getWidth(),0.04*getHeight());
     outputChans->setBounds(getWidth() - 0.2*getWidth(), 0.15*getHeight(), 0.18*getWidth(),0.04*getHeight());
+    keypointSelector->setBounds(getWidth() - 0.2*getWidth(), 0.2*getHeight(), 0.18*getWidth(),0.04*getHeight());
 
     // Static Labels
     sourcesLabel->setBounds(getWidth() - 0.2*getWidth(), 0.0*getHeight(), 0.08*getWidth(), 0.04*getHeight());
@@ -203,6 +196,11 @@ void TrackingStimulatorCanvas::comboBoxChanged(ComboBox* comboBox)
             selectedSource = -1;
         processor->setSelectedSource(selectedSource);
     }
+    else if (comboBox == keypointSelector)
+    {
+        // First item is the position of the sources
+        processor->setKeypoint(comboBox->getSelectedId() - 2);
+    }
     else if (comboBox == outputChans)
     {
         if (comboBox->getSelectedId() > 0)
@@ -272,20 +270,14 @@ void TrackingStimulatorCanvas::buttonClicked(Button* button)
         Value x = cxEditLabel->getTextValue();
         Value y = cyEditLabel->getTextValue();
         Value rad = cradEditLabel->getTextValue();
-        if (processor->getCircles().size() < MAX_CIRCLES)
-        {
-            processor->addCircle(StimCircle(float(x.getValue()), float(y.getValue()), float(rad.getValue()), m_onoff));
-            processor->setSelectedCircle(processor->getCircles().size()-1);
-            circlesButton[processor->getSelectedCircle()]->setVisible(true);
-
-            // toggle current circle button (untoggles all the others)
-            if (circlesButton[processor->getSelectedCircle()]->getToggleState()==false)
-                circlesButton[processor->getSelectedCircle()]->triggerClick();
-            m_isDeleting = false;
-        }
-        else
-            CoreServices::sendStatusMessage("Max number of circles reached!");
+        processor->addCircle(StimCircle(float(x.getValue()), float(y.getValue()), float(rad.getValue()), m_onoff));
+        processor->setSelectedCircle(processor->getCircles().size()-1);
+        uploadCircles();
 
+        // toggle current circle button (untoggles all the others)
+        if (circlesButton[processor->getSelectedCircle()]->getToggleState()==false)
+            circlesButton[processor->getSelectedCircle()]->triggerClick();
+        m_isDeleting = false;
 
     }
     else if (button == editButton)
@@ -304,13 +296,7 @@ void TrackingStimulatorCanvas::buttonClicked(Button* button)
 
         processor->deleteCircle(processor->getSelectedCircle());
         // make visible only the remaining labels
-        for (int i = 0; i<MAX_CIRCLES; i++)
-        {
-            if (i<processor->getCircles().size())
-                circlesButton[i]->setVisible(true);
-            else
-                circlesButton[i]->setVisible(false);
-        }
+        uploadCircles();
 
         // Blank labels and untoggle all circle buttons
         processor->setSelectedCircle(-1);
@@ -319,7 +305,7 @@ void TrackingStimulatorCanvas::buttonClicked(Button* button)
         cradEditLabel->setText(String(""), dontSendNotification);
         m_onoff = false;
 
-        for (int i = 0; i<MAX_CIRCLES; i++)
+        for (int i = 0; i<circlesButton.size(); i++)
             //            circlesButton[i]->setEnabledState(false);
             circlesButton[i]->setToggleState(false, true);
 
@@ -408,14 +394,14 @@ void TrackingStimulatorCanvas::buttonClicked(Button* button)
     {
         // check if one of circle button has been clicked
         bool someToggled = false;
-        for (int i = 0; i<MAX_CIRCLES; i++)
+        for (int i = 0; i<circlesButton.size(); i++)
         {
             if (button == circlesButton[i] && circlesButton[i]->isVisible() )
             {
                 // toggle button and untoggle all the others + update
                 if (button->getToggleState()==true)
                 {
-                    for (int j = 0; j<MAX_CIRCLES; j++)
+                    for (int j = 0; j<circlesButton.size(); j++)
                         if (i!=j && circlesButton[j]->getToggleState()==true)
                         {
                             //                        circlesButton[j]->triggerClick();
@@ -452,13 +438,40 @@ void TrackingStimulatorCanvas::buttonClicked(Button* button)
 
 void TrackingStimulatorCanvas::uploadCircles()
 {
+    const int nCircles = int(processor->getCircles().size());
+
+    // create the toggle buttons of new circles
+    for (int i = circlesButton.size(); i<nCircles; i++)
+    {
+        UtilityButton* circButton = new UtilityButton(String(i+1), Font("Small Text", 13, Font::plain));
+        circButton->setRadius(5.0f);
+        circButton->addListener(this);
+        circButton->setClickingTogglesState(true);
+        circlesButton.add(circButton);
+        addChildComponent(circButton);
+    }
+
     // circle buttons visible
-    for (int i = 0; i<MAX_CIRCLES; i++)
+    for (int i = 0; i<circlesButton.size(); i++)
+        circlesButton[i]->setVisible(i<nCircles);
+
+    layoutCircleButtons();
+}
+
+void TrackingStimulatorCanvas::layoutCircleButtons()
+{
+    // rows of circle buttons share the space above the parameters, getting
+    // thinner as circles are added
+    int nRows = jmax(1, (circlesButton.size() + CIRCLE_BUTTONS_PER_ROW - 1) / CIRCLE_BUTTONS_PER_ROW);
+    float buttonWidth = (0.18/CIRCLE_BUTTONS_PER_ROW)*getWidth();
+    float rowHeight = jmin(0.03f, 0.09f/nRows)*getHeight();
+
+    for (int i = 0; i<circlesButton.size(); i++)
     {
-        if (i<processor->getCircles().size())
-            circlesButton[i]->setVisible(true);
-        else
-            circlesButton[i]->setVisible(false);
+        int row = i / CIRCLE_BUTTONS_PER_ROW;
+        int col = i % CIRCLE_BUTTONS_PER_ROW;
+        circlesButton[i]->setBounds(getWidth() - 0.2*getWidth() + col*buttonWidth, 0.5*getHeight() + row*rowHeight,
+                                    buttonWidth, rowHeight);
     }
 }
 
@@ -549,6 +562,19 @@ void TrackingStimulatorCanvas::update()
         availableChans->addItem(name, nextItem++);
     }
     availableChans->setSelectedId(processor->getSelectedSource()+2); //first is SELECT
+
+    // Keypoints of the sources that have some, named after the first one
+    keypointSelector->clear();
+    keypointSelector->addItem("Position", 1);
+    int nKeypoints = 0;
+    for (int i = 0; i < nSources; i++)
+    {
+        TrackingSources& source = processor->getTrackingSource(i);
+        for (int k = nKeypoints; k < source.numKeypoints; k++)
+            keypointSelector->addItem(getKeypointName(source, k), k + 2);
+        nKeypoints = jmax(nKeypoints, source.numKeypoints);
+    }
+    keypointSelector->setSelectedId(processor->getKeypoint()+2, dontSendNotification);
 }
 
 void TrackingStimulatorCanvas::refresh()
@@ -645,6 +671,13 @@ void TrackingStimulatorCanvas::initButtons()
 
     addAndMakeVisible(availableChans);
 
+    keypointSelector = new ComboBox("Keypoints");
+    keypointSelector->setEditableText(false);
+    keypointSelector->setJustificationType(Justification::centredLeft);
+    keypointSelector->setTooltip("Track the position of the sources, or one of their keypoints");
+    keypointSelector->addListener(this);
+    addAndMakeVisible(keypointSelector);
+
     outputChans = new ComboBox("Output Channels");
 
     outputChans->setEditableText(false);
@@ -659,16 +692,8 @@ void TrackingStimulatorCanvas::initButtons()
     addAndMakeVisible(outputChans);
 
 
-    // Create invisible circle toggle button
-    for (int i = 0; i<MAX_CIRCLES; i++)
-    {
-        newcircButton = new UtilityButton(String(i+1), Font("Small Text", 13, Font::plain));
-        newcircButton->setRadius(5.0f);
-        newcircButton->addListener(this);
-        newcircButton->setClickingTogglesState(true);
-        circlesButton[i] = newcircButton;
-        addAndMakeVisible(circlesButton[i]);
-    }
+    // Create circle toggle buttons of the loaded circles
+    uploadCircles();
 
     uniformButton = new UtilityButton("uni", Font("Small Text", 13, Font::plain));
     uniformButton->setRadius(3.0f);
@@ -947,6 +972,46 @@ void DisplayAxes::paint(Graphics& g){
                 }
             }
         }
+
+        // draw the rectangles, ellipses and polygons if they are ON
+        g.setColour(unselectedCircleColour);
+        for (int i = 0; i < processor->getNumShapes(); i++)
+        {
+            StimArea* shape = processor->getShape(i);
+            if (!shape->getOn())
+                continue;
+
+            float x_c = shape->getX() * getWidth() + xlims[0];
+            float y_c = shape->getY() * getHeight() + ylims[0];
+
+            if (StimRect* rect = dynamic_cast<StimRect*>(shape))
+            {
+                float w = rect->getW() * getWidth();
+                float h = rect->getH() * getHeight();
+                g.fillRect(x_c - w/2, y_c - h/2, w, h);
+            }
+            else if (StimEllipse* ellipse = dynamic_cast<StimEllipse*>(shape))
+            {
+                float radx = ellipse->getRx() * getWidth();
+                float rady = ellipse->getRy() * getHeight();
+                g.fillEllipse(x_c - radx, y_c - rady, 2*radx, 2*rady);
+            }
+            else if (StimPolygon* polygon = dynamic_cast<StimPolygon*>(shape))
+            {
+                Path outline;
+                for (int v = 0; v < polygon->getNumVertices(); v++)
+                {
+                    float x = polygon->getVertexX(v) * getWidth() + xlims[0];
+                    float y = polygon->getVertexY(v) * getHeight() + ylims[0];
+                    if (v == 0)
+                        outline.startNewSubPath(x, y);
+                    else
+                        outline.lineTo(x, y);
+                }
+                outline.closeSubPath();
+                g.fillPath(outline);
+            }
+        }
     }
 
     // Draw a point for the current position
@@ -963,9 +1028,7 @@ void DisplayAxes::paint(Graphics& g){
             x = int(pos_x * getWidth() + xlims[0]);
             y = int(pos_y * getHeight() + ylims[0]);
 
-            int circleIn = processor->isPositionWithinCircles(pos_x, pos_y);
-
-            if (circleIn != -1 && processor->getCircles()[circleIn].getOn())
+            if (processor->isPositionWithinActiveZone(pos_x, pos_y))
                 g.setColour(inOfCirclesColour);
             else
                 g.setColour(outOfCirclesColour);
@@ -984,9 +1047,7 @@ void DisplayAxes::paint(Graphics& g){
             x = int(pos_x * getWidth() + xlims[0]);
             y = int(pos_y * getHeight() + ylims[0]);
 
-            int circleIn = processor->isPositionWithinCircles(pos_x, pos_y);
-
-            if (circleIn != -1 && processor->getCircles()[circleIn].getOn())
+            if (processor->isPositionWithinActiveZone(pos_x, pos_y))
                 g.setColour(inOfCirclesColour);
             else
                 g.setColour(outOfCirclesColour);
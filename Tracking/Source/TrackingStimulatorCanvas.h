@@ -36,6 +36,8 @@
 #include "TrackingStimulatorEditor.h"
 #include "TrackingStimulator.h"
 
+#define CIRCLE_BUTTONS_PER_ROW 9
+
 class DisplayAxes;
 
 /**
@@ -87,6 +89,7 @@ public:
     void setOnButton();
     float my_round(float x);
     void uploadCircles();
+    void layoutCircleButtons();
     int getSelectedSource() const;
 
 private:
@@ -125,13 +128,14 @@ private:
     ScopedPointer<UtilityButton> editButton;
     ScopedPointer<UtilityButton> delButton;
     ScopedPointer<UtilityButton> onButton;
-    ScopedPointer<UtilityButton> newcircButton;
-    ScopedPointer<UtilityButton> circlesButton[MAX_CIRCLES];
+    // One toggle per circle, created as circles are added
+    OwnedArray<UtilityButton> circlesButton;
     ScopedPointer<UtilityButton> uniformButton;
     ScopedPointer<UtilityButton> gaussianButton;
     ScopedPointer<UtilityButton> ttlButton;
 
     ScopedPointer<ComboBox> availableChans;
+    ScopedPointer<ComboBox> keypointSelector;
     ScopedPointer<ComboBox> outputChans;
 
     ScopedPointer<UtilityButton> simTrajectoryButton;
@@ -0,0 +1,666 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TrackingStimulatorZones.h"
+
+// StimArea methods
+
+
+StimArea::StimArea() :
+    m_cx(0),
+    m_cy(0),
+    m_on(false)
+{
+}
+
+StimArea::StimArea(float x, float y, bool on) :
+    m_cx(x),
+    m_cy(y),
+    m_on(on)
+{
+}
+
+StimArea::~StimArea()
+{
+}
+
+float StimArea::getX()
+{
+    return m_cx;
+}
+float StimArea::getY()
+{
+    return m_cy;
+}
+bool StimArea::getOn()
+{
+    return m_on;
+}
+
+void StimArea::setX(float x)
+{
+    m_cx = x;
+}
+void StimArea::setY(float y)
+{
+    m_cy = y;
+}
+
+bool StimArea::on()
+{
+    m_on = true;
+    return m_on;
+}
+bool StimArea::off()
+{
+    m_on = false;
+    return m_on;
+}
+
+// Circle methods
+
+StimCircle::StimCircle()
+    : m_rad(0), StimArea(0, 0, false)
+{
+}
+
+StimCircle::StimCircle(float x, float y, float rad, bool on) : StimArea(x, y, on)
+{
+    m_rad = rad;
+}
+
+float StimCircle::getRad()
+{
+    return m_rad;
+}
+
+void StimCircle::setRad(float rad)
+{
+    m_rad = rad;
+}
+void StimCircle::set(float x, float y, float rad, bool on)
+{
+    m_cx = x;
+    m_cy = y;
+    m_rad = rad;
+    m_on = on;
+}
+
+bool StimCircle::isPositionIn(float x, float y)
+{
+    const float dx = x - m_cx;
+    const float dy = y - m_cy;
+    return dx*dx + dy*dy <= m_rad*m_rad;
+}
+
+float StimCircle::distanceFromCenter(float x, float y){
+    const float dx = x - m_cx;
+    const float dy = y - m_cy;
+    return std::sqrt(dx*dx + dy*dy);
+}
+
+String StimCircle::returnType()
+{
+    return String("circle");
+}
+
+// Rect methods
+
+StimRect::StimRect()
+    : m_w(0), m_h(0), StimArea(0, 0, false)
+{
+}
+
+StimRect::StimRect(float x, float y, float w, float h, bool on) : StimArea(x, y, on)
+{
+    m_w = w;
+    m_h = h;
+}
+
+float StimRect::getW()
+{
+    return m_w;
+}
+float StimRect::getH()
+{
+    return m_h;
+}
+
+void StimRect::setW(float w)
+{
+    m_w = w;
+}
+void StimRect::setH(float h)
+{
+    m_h = h;
+}
+void StimRect::set(float x, float y, float w, float h, bool on)
+{
+    m_cx = x;
+    m_cy = y;
+    m_w = w;
+    m_h = h;
+    m_on = on;
+}
+
+bool StimRect::isPositionIn(float x, float y)
+{
+    if ((std::abs(x - m_cx) < m_w / 2.0) && (std::abs(y - m_cy) < m_h / 2.0))
+        return true;
+    else
+        return false;
+}
+
+float StimRect::distanceFromCenter(float x, float y){
+    return std::abs(x - m_cx) + std::abs(y - m_cy);
+}
+
+String StimRect::returnType()
+{
+    return String("rect");
+}
+
+// Ellipse methods
+
+StimEllipse::StimEllipse()
+    : m_rx(0), m_ry(0), StimArea(0, 0, false)
+{
+}
+
+StimEllipse::StimEllipse(float x, float y, float rx, float ry, bool on) : StimArea(x, y, on)
+{
+    m_rx = rx;
+    m_ry = ry;
+}
+
+float StimEllipse::getRx()
+{
+    return m_rx;
+}
+float StimEllipse::getRy()
+{
+    return m_ry;
+}
+
+void StimEllipse::setRx(float rx)
+{
+    m_rx = rx;
+}
+void StimEllipse::setRy(float ry)
+{
+    m_ry = ry;
+}
+void StimEllipse::set(float x, float y, float rx, float ry, bool on)
+{
+    m_cx = x;
+    m_cy = y;
+    m_rx = rx;
+    m_ry = ry;
+    m_on = on;
+}
+
+bool StimEllipse::isPositionIn(float x, float y)
+{
+    const float dx = (x - m_cx) / m_rx;
+    const float dy = (y - m_cy) / m_ry;
+    return dx*dx + dy*dy <= 1;
+}
+
+float StimEllipse::distanceFromCenter(float x, float y){
+    const float dx = x - m_cx;
+    const float dy = y - m_cy;
+    return std::sqrt(dx*dx + dy*dy);
+}
+
+String StimEllipse::returnType()
+{
+    return String("ellipse");
+}
+
+// Polygon methods
+
+StimPolygon::StimPolygon()
+    : StimArea(0, 0, false)
+{
+}
+
+StimPolygon::StimPolygon(const std::vector<float>& xs, const std::vector<float>& ys, bool on)
+    : StimArea(0, 0, on)
+    , m_xs(xs)
+    , m_ys(ys)
+{
+    m_ys.resize(m_xs.size());
+    for (int v = 0; v < m_xs.size(); v++)
+    {
+        m_cx += m_xs[v] / m_xs.size();
+        m_cy += m_ys[v] / m_xs.size();
+    }
+}
+
+int StimPolygon::getNumVertices()
+{
+    return int(m_xs.size());
+}
+float StimPolygon::getVertexX(int v)
+{
+    return m_xs[v];
+}
+float StimPolygon::getVertexY(int v)
+{
+    return m_ys[v];
+}
+
+bool StimPolygon::isPositionIn(float x, float y)
+{
+    // even-odd rule
+    bool in = false;
+    for (int v = 0, prev = int(m_xs.size()) - 1; v < m_xs.size(); prev = v++)
+    {
+        if (((m_ys[v] > y) != (m_ys[prev] > y)) &&
+                (x < (m_xs[prev] - m_xs[v]) * (y - m_ys[v]) / (m_ys[prev] - m_ys[v]) + m_xs[v]))
+            in = !in;
+    }
+    return in;
+}
+
+float StimPolygon::distanceFromCenter(float x, float y){
+    const float dx = x - m_cx;
+    const float dy = y - m_cy;
+    return std::sqrt(dx*dx + dy*dy);
+}
+
+String StimPolygon::returnType()
+{
+    return String("polygon");
+}
+
+// Zone index methods
+
+StimZoneIndex::StimZoneIndex()
+    : m_resolution(1)
+    , m_cells(1)
+{
+}
+
+int StimZoneIndex::cellOf(float v) const
+{
+    // Positions and bounds outside the arena fall in the border cells, which
+    // keeps the lookup exact for them too; NaN lands in the first cell
+    if (! (v > 0))
+        return 0;
+    if (v >= 1)
+        return m_resolution - 1;
+    return jmin(m_resolution - 1, int(v * m_resolution));
+}
+
+void StimZoneIndex::addZone(ZoneKind kind, float cx, float cy, float a, float b, bool on,
+                            float x0, float y0, float x1, float y1)
+{
+    m_kind.push_back(kind);
+    m_cx.push_back(cx);
+    m_cy.push_back(cy);
+    m_a.push_back(a);
+    m_b.push_back(b);
+    m_on.push_back(on);
+    m_x0.push_back(x0);
+    m_y0.push_back(y0);
+    m_x1.push_back(x1);
+    m_y1.push_back(y1);
+    m_edgeBegin.push_back(int(m_ex0.size()));
+    m_edgeEnd.push_back(int(m_ex0.size()));
+}
+
+void StimZoneIndex::build(const std::vector<StimCircle>& circles, const OwnedArray<StimArea>& shapes)
+{
+    m_kind.clear();
+    m_cx.clear();
+    m_cy.clear();
+    m_a.clear();
+    m_b.clear();
+    m_on.clear();
+    m_x0.clear();
+    m_y0.clear();
+    m_x1.clear();
+    m_y1.clear();
+    m_edgeBegin.clear();
+    m_edgeEnd.clear();
+    m_ex0.clear();
+    m_ey0.clear();
+    m_ex1.clear();
+    m_ey1.clear();
+    m_slope.clear();
+
+    for (int i = 0; i < circles.size(); i++)
+    {
+        StimCircle circle = circles[i];
+        const float cx = circle.getX();
+        const float cy = circle.getY();
+        const float rad = circle.getRad();
+        addZone(circleZone, cx, cy, rad, rad, circle.getOn(), cx - rad, cy - rad, cx + rad, cy + rad);
+    }
+
+    for (int i = 0; i < shapes.size(); i++)
+    {
+        StimArea* shape = shapes[i];
+        const float cx = shape->getX();
+        const float cy = shape->getY();
+
+        if (StimRect* rect = dynamic_cast<StimRect*>(shape))
+        {
+            const float hw = rect->getW() / 2;
+            const float hh = rect->getH() / 2;
+            addZone(rectZone, cx, cy, hw, hh, shape->getOn(), cx - hw, cy - hh, cx + hw, cy + hh);
+        }
+        else if (StimEllipse* ellipse = dynamic_cast<StimEllipse*>(shape))
+        {
+            const float rx = ellipse->getRx();
+            const float ry = ellipse->getRy();
+            addZone(ellipseZone, cx, cy, rx, ry, shape->getOn(), cx - rx, cy - ry, cx + rx, cy + ry);
+        }
+        else if (StimPolygon* polygon = dynamic_cast<StimPolygon*>(shape))
+        {
+            const int nVertices = polygon->getNumVertices();
+            float x0 = cx, y0 = cy, x1 = cx, y1 = cy;
+            float farthest = 0;
+            for (int v = 0; v < nVertices; v++)
+            {
+                const float vx = polygon->getVertexX(v);
+                const float vy = polygon->getVertexY(v);
+                x0 = jmin(x0, vx);
+                y0 = jmin(y0, vy);
+                x1 = jmax(x1, vx);
+                y1 = jmax(y1, vy);
+                farthest = jmax(farthest, polygon->distanceFromCenter(vx, vy));
+            }
+            addZone(polygonZone, cx, cy, farthest, farthest, shape->getOn(), x0, y0, x1, y1);
+
+            for (int v = 0; v < nVertices; v++)
+            {
+                const int next = (v + 1) % nVertices;
+                const float ex0 = polygon->getVertexX(v);
+                const float ey0 = polygon->getVertexY(v);
+                const float ex1 = polygon->getVertexX(next);
+                const float ey1 = polygon->getVertexY(next);
+                m_ex0.push_back(ex0);
+                m_ey0.push_back(ey0);
+                m_ex1.push_back(ex1);
+                m_ey1.push_back(ey1);
+                // horizontal edges never cross the horizontal ray
+                m_slope.push_back(ey1 != ey0 ? (ex1 - ex0) / (ey1 - ey0) : 0.f);
+            }
+            m_edgeEnd.back() = int(m_ex0.size());
+        }
+    }
+
+    // About one zone per cell when they are spread over the arena
+    const int nZones = getNumZones();
+    m_resolution = jlimit(1, STIM_GRID_MAX, int(std::ceil(std::sqrt(double(nZones)))));
+    m_cells.assign(m_resolution * m_resolution, std::vector<int>());
+
+    for (int i = 0; i < nZones; i++)
+    {
+        const int x0 = cellOf(m_x0[i]);
+        const int x1 = cellOf(m_x1[i]);
+        const int y0 = cellOf(m_y0[i]);
+        const int y1 = cellOf(m_y1[i]);
+        for (int cy = y0; cy <= y1; cy++)
+            for (int cx = x0; cx <= x1; cx++)
+                m_cells[cy * m_resolution + cx].push_back(i);
+    }
+}
+
+int StimZoneIndex::getNumZones() const
+{
+    return int(m_kind.size());
+}
+
+bool StimZoneIndex::getZoneOn(int zone) const
+{
+    return m_on[zone] != 0;
+}
+
+void StimZoneIndex::getZoneBounds(int zone, float& x0, float& y0, float& x1, float& y1) const
+{
+    x0 = m_x0[zone];
+    y0 = m_y0[zone];
+    x1 = m_x1[zone];
+    y1 = m_y1[zone];
+}
+
+bool StimZoneIndex::polygonContains(int zone, float x, float y) const
+{
+    // Even-odd rule over the edges of the polygon, written without branches
+    // so the compiler vectorizes it
+    const int end = m_edgeEnd[zone];
+    const float* ex0 = m_ex0.data();
+    const float* ey0 = m_ey0.data();
+    const float* ey1 = m_ey1.data();
+    const float* slope = m_slope.data();
+    int crossings = 0;
+    for (int e = m_edgeBegin[zone]; e < end; e++)
+        crossings += int((ey0[e] > y) != (ey1[e] > y)) & int(x < ex0[e] + slope[e] * (y - ey0[e]));
+    return (crossings & 1) != 0;
+}
+
+bool StimZoneIndex::contains(int zone, float x, float y) const
+{
+    const float dx = x - m_cx[zone];
+    const float dy = y - m_cy[zone];
+    switch (m_kind[zone])
+    {
+        case circleZone:
+            return dx*dx + dy*dy <= m_a[zone] * m_a[zone];
+        case rectZone:
+            return std::abs(dx) < m_a[zone] && std::abs(dy) < m_b[zone];
+        case ellipseZone:
+        {
+            const float nx = dx / m_a[zone];
+            const float ny = dy / m_b[zone];
+            return nx*nx + ny*ny <= 1;
+        }
+        case polygonZone:
+            return polygonContains(zone, x, y);
+    }
+    return false;
+}
+
+bool StimZoneIndex::isNear(int zone, float x, float y, float pad) const
+{
+    const float dx = x - m_cx[zone];
+    const float dy = y - m_cy[zone];
+    switch (m_kind[zone])
+    {
+        case circleZone:
+            return dx*dx + dy*dy <= (m_a[zone] + pad) * (m_a[zone] + pad);
+        case rectZone:
+            return std::abs(dx) <= m_a[zone] + pad && std::abs(dy) <= m_b[zone] + pad;
+        case ellipseZone:
+        {
+            const float nx = dx / (m_a[zone] + pad);
+            const float ny = dy / (m_b[zone] + pad);
+            return nx*nx + ny*ny <= 1;
+        }
+        case polygonZone:
+        {
+            if (polygonContains(zone, x, y))
+                return true;
+            // distance from each edge, clamped to the segment
+            for (int e = m_edgeBegin[zone]; e < m_edgeEnd[zone]; e++)
+            {
+                const float sx = m_ex1[e] - m_ex0[e];
+                const float sy = m_ey1[e] - m_ey0[e];
+                const float len2 = sx*sx + sy*sy;
+                const float t = len2 > 0 ? jlimit(0.f, 1.f, ((x - m_ex0[e]) * sx + (y - m_ey0[e]) * sy) / len2) : 0.f;
+                const float px = m_ex0[e] + t * sx - x;
+                const float py = m_ey0[e] + t * sy - y;
+                if (px*px + py*py <= pad*pad)
+                    return true;
+            }
+            return false;
+        }
+    }
+    return false;
+}
+
+float StimZoneIndex::distance(int zone, float x, float y) const
+{
+    const float dx = x - m_cx[zone];
+    const float dy = y - m_cy[zone];
+    if (m_kind[zone] == rectZone)
+        return std::abs(dx) + std::abs(dy);
+    return std::sqrt(dx*dx + dy*dy);
+}
+
+float StimZoneIndex::normalizedDistance(int zone, float x, float y) const
+{
+    const float dx = x - m_cx[zone];
+    const float dy = y - m_cy[zone];
+    switch (m_kind[zone])
+    {
+        case rectZone:
+            return std::abs(dx) / m_a[zone] + std::abs(dy) / m_b[zone];
+        case ellipseZone:
+            return std::sqrt((dx*dx) / (m_a[zone] * m_a[zone]) + (dy*dy) / (m_b[zone] * m_b[zone]));
+        default:
+            return std::sqrt(dx*dx + dy*dy) / m_a[zone];
+    }
+}
+
+void StimZoneIndex::query(float x, float y, std::vector<StimZoneHit>& hits) const
+{
+    hits.clear();
+    const std::vector<int>& cell = m_cells[cellOf(y) * m_resolution + cellOf(x)];
+    for (int i : cell)
+    {
+        if (contains(i, x, y))
+        {
+            StimZoneHit hit;
+            hit.zone = i;
+            hit.distance = distance(i, x, y);
+            hits.push_back(hit);
+        }
+    }
+}
+
+int StimZoneIndex::first(float x, float y) const
+{
+    const std::vector<int>& cell = m_cells[cellOf(y) * m_resolution + cellOf(x)];
+    for (int i : cell)
+    {
+        if (contains(i, x, y))
+            return i;
+    }
+    return -1;
+}
+
+// Rate map methods
+
+StimRateMap::StimRateMap()
+    : m_rates(RATE_MAP_SIZE * RATE_MAP_SIZE, 0.f)
+{
+}
+
+void StimRateMap::paintZone(const StimZoneIndex& zones, int zone, bool interior,
+                            stim_mode mode, float freq, float logSD)
+{
+    const float texel = 1.f / RATE_MAP_SIZE;
+    // Past the border by enough for every bilinear fetch inside the zone
+    const float pad = 1.5f * texel;
+
+    float x0, y0, x1, y1;
+    zones.getZoneBounds(zone, x0, y0, x1, y1);
+    if (! (x1 >= x0 && y1 >= y0))
+        return;
+    const int i0 = jlimit(0, RATE_MAP_SIZE - 1, int(std::floor((x0 - pad) * RATE_MAP_SIZE)));
+    const int i1 = jlimit(0, RATE_MAP_SIZE - 1, int(std::floor((x1 + pad) * RATE_MAP_SIZE)));
+    const int j0 = jlimit(0, RATE_MAP_SIZE - 1, int(std::floor((y0 - pad) * RATE_MAP_SIZE)));
+    const int j1 = jlimit(0, RATE_MAP_SIZE - 1, int(std::floor((y1 + pad) * RATE_MAP_SIZE)));
+
+    for (int j = j0; j <= j1; j++)
+    {
+        const float y = (j + 0.5f) * texel;
+        for (int i = i0; i <= i1; i++)
+        {
+            const float x = (i + 0.5f) * texel;
+            if (interior ? ! zones.contains(zone, x, y) : ! zones.isNear(zone, x, y, pad))
+                continue;
+
+            // gaussian rate: freq * exp(-d^2 / k), with k = -1 / log(sd) and d
+            // the distance from the center normalized by the zone size
+            float rate = freq;
+            if (mode == gauss)
+            {
+                const float dist_norm = zones.normalizedDistance(zone, x, y);
+                rate = freq * std::exp(dist_norm * dist_norm * logSD);
+            }
+            // degenerate zones, e.g. of radius 0, never stimulate
+            if (rate == rate)
+                m_rates[j * RATE_MAP_SIZE + i] = rate;
+        }
+    }
+}
+
+void StimRateMap::build(const StimZoneIndex& zones, const std::vector<char>& zoneMask,
+                        stim_mode mode, float freq, float sd)
+{
+    std::fill(m_rates.begin(), m_rates.end(), 0.f);
+
+    const float logSD = std::log(sd);
+
+    // Borders first, then the insides on top of them, each painted last to
+    // first so the first zone ends up on top where zones overlap
+    for (int zone = zones.getNumZones() - 1; zone >= 0; zone--)
+        if (zoneMask[zone])
+            paintZone(zones, zone, false, mode, freq, logSD);
+    for (int zone = zones.getNumZones() - 1; zone >= 0; zone--)
+        if (zoneMask[zone])
+            paintZone(zones, zone, true, mode, freq, logSD);
+}
+
+float StimRateMap::rateAt(float x, float y) const
+{
+    // Positions outside the arena take the rate of the border texels
+    const float u = jlimit(0.f, float(RATE_MAP_SIZE - 1), x * RATE_MAP_SIZE - 0.5f);
+    const float v = jlimit(0.f, float(RATE_MAP_SIZE - 1), y * RATE_MAP_SIZE - 0.5f);
+    if (u != u || v != v)
+        return 0.f;
+
+    const int i0 = int(u);
+    const int j0 = int(v);
+    const int i1 = jmin(i0 + 1, RATE_MAP_SIZE - 1);
+    const int j1 = jmin(j0 + 1, RATE_MAP_SIZE - 1);
+    const float fu = u - i0;
+    const float fv = v - j0;
+
+    const float top = m_rates[j0 * RATE_MAP_SIZE + i0] * (1.f - fu) + m_rates[j0 * RATE_MAP_SIZE + i1] * fu;
+    const float bottom = m_rates[j1 * RATE_MAP_SIZE + i0] * (1.f - fu) + m_rates[j1 * RATE_MAP_SIZE + i1] * fu;
+    return top * (1.f - fv) + bottom * fv;
+}
@@ -0,0 +1,294 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Tracking plugin for the Open Ephys GUI
+    Written by:
+
+    Alessio Buccino     alessiob@ifi.uio.no
+    Mikkel Lepperod
+    Svenn-Arne Dragly
+
+    Center for Integrated Neuroplasticity CINPLA
+    Department of Biosciences
+    University of Oslo
+    Norway
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACKINGSTIMULATORZONES_H
+#define TRACKINGSTIMULATORZONES_H
+
+#include <ProcessorHeaders.h>
+
+#include <vector>
+
+#define STIM_GRID_MAX 64
+#define RATE_MAP_SIZE 256
+
+/**
+
+  Class for Abstrac Stimulation Area
+
+*/
+class StimArea
+{
+public:
+    StimArea();
+    StimArea(float x, float y, bool on);
+    virtual ~StimArea();
+
+    float getX();
+    float getY();
+    bool getOn();
+    void setX(float x);
+    void setY(float y);
+
+    bool on();
+    bool off();
+
+    virtual bool isPositionIn(float x, float y) = 0;
+    virtual float distanceFromCenter(float x, float y) = 0;
+    virtual String returnType() = 0;
+
+protected:
+
+    float m_cx;
+    float m_cy;
+    bool m_on;
+
+};
+/**
+
+  Class for Stimulation Circles
+
+*/
+class StimCircle : public StimArea
+{
+public:
+    StimCircle();
+    StimCircle(float x, float y, float r, bool on);
+
+    float getRad();
+
+    void setRad(float rad);
+    void set(float x, float y, float rad, bool on);
+
+    bool isPositionIn(float x, float y);
+    float distanceFromCenter(float x, float y);
+    String returnType();
+
+private:
+    float m_rad;
+};
+
+/**
+
+  Class for Stimulation Rectangle
+
+*/
+class StimRect : public StimArea
+{
+public:
+    StimRect();
+    StimRect(float x, float y, float w, float h, bool on);
+
+    float getW();
+    float getH();
+
+    void setW(float w);
+    void setH(float h);
+    void set(float x, float y, float w, float h, bool on);
+
+    bool isPositionIn(float x, float y) override;
+    float distanceFromCenter(float x, float y) override;
+    String returnType() override;
+
+private:
+    float m_w;
+    float m_h;
+};
+
+
+/**
+
+  Class for Stimulation Ellipses
+
+*/
+class StimEllipse : public StimArea
+{
+public:
+    StimEllipse();
+    StimEllipse(float x, float y, float rx, float ry, bool on);
+
+    float getRx();
+    float getRy();
+
+    void setRx(float rx);
+    void setRy(float ry);
+    void set(float x, float y, float rx, float ry, bool on);
+
+    bool isPositionIn(float x, float y) override;
+    float distanceFromCenter(float x, float y) override;
+    String returnType() override;
+
+private:
+    float m_rx;
+    float m_ry;
+};
+
+/**
+
+  Class for Stimulation Polygons, e.g. maze arms or linear track segments.
+  The last vertex joins back to the first and the center is the mean vertex.
+
+*/
+class StimPolygon : public StimArea
+{
+public:
+    StimPolygon();
+    StimPolygon(const std::vector<float>& xs, const std::vector<float>& ys, bool on);
+
+    int getNumVertices();
+    float getVertexX(int v);
+    float getVertexY(int v);
+
+    bool isPositionIn(float x, float y) override;
+    float distanceFromCenter(float x, float y) override;
+    String returnType() override;
+
+private:
+    std::vector<float> m_xs;
+    std::vector<float> m_ys;
+};
+
+/** A zone containing a queried position, and the distance of the position from its center */
+struct StimZoneHit
+{
+    int zone;
+    float distance;
+};
+
+/**
+
+  Uniform grid over the bounding boxes of the stimulation zones, in the
+  normalized arena. A position is only tested against the zones overlapping
+  its cell, so the lookup stays cheap with hundreds of small zones. The zones
+  are flattened into arrays, with the polygon edges laid out for a vectorized
+  crossing test.
+
+*/
+class StimZoneIndex
+{
+public:
+    StimZoneIndex();
+
+    /** Circles are zones 0 to circles.size() - 1, followed by the shapes */
+    void build (const std::vector<StimCircle>& circles, const OwnedArray<StimArea>& shapes);
+
+    /** Fills hits with every zone containing (x, y), in zone order */
+    void query (float x, float y, std::vector<StimZoneHit>& hits) const;
+    /** Index of the first zone containing (x, y), -1 if none */
+    int first (float x, float y) const;
+
+    int getNumZones() const;
+    bool getZoneOn (int zone) const;
+    void getZoneBounds (int zone, float& x0, float& y0, float& x1, float& y1) const;
+
+    bool contains (int zone, float x, float y) const;
+    /** Whether (x, y) is inside the zone or within pad of its border */
+    bool isNear (int zone, float x, float y, float pad) const;
+    /** Distance of (x, y) from the center of the zone, as StimArea::distanceFromCenter */
+    float distance (int zone, float x, float y) const;
+    /** Distance of (x, y) from the center of the zone in the metric of distance(),
+        with each axis scaled by the half size of the zone: 1 on the border of
+        circles and ellipses, and at the middle of the sides of rectangles, whose
+        L1 distance reaches 2 at their corners */
+    float normalizedDistance (int zone, float x, float y) const;
+
+private:
+    enum ZoneKind { circleZone, rectZone, ellipseZone, polygonZone };
+
+    void addZone (ZoneKind kind, float cx, float cy, float a, float b, bool on,
+                  float x0, float y0, float x1, float y1);
+    int cellOf (float v) const;
+    bool polygonContains (int zone, float x, float y) const;
+
+    int m_resolution;
+    // Zone indices overlapping each cell, ascending
+    std::vector<std::vector<int>> m_cells;
+
+    // Per zone; a and b are the radius (circles), the half width and height
+    // (rectangles), the radii (ellipses) or the farthest vertex (polygons)
+    std::vector<ZoneKind> m_kind;
+    std::vector<float> m_cx;
+    std::vector<float> m_cy;
+    std::vector<float> m_a;
+    std::vector<float> m_b;
+    std::vector<char> m_on;
+    std::vector<float> m_x0;
+    std::vector<float> m_y0;
+    std::vector<float> m_x1;
+    std::vector<float> m_y1;
+    std::vector<int> m_edgeBegin;
+    std::vector<int> m_edgeEnd;
+
+    // Polygon edges from (x0, y0) to (x1, y1), with dx / dy precomputed
+    std::vector<float> m_ex0;
+    std::vector<float> m_ey0;
+    std::vector<float> m_ex1;
+    std::vector<float> m_ey1;
+    std::vector<float> m_slope;
+};
+
+typedef enum
+{
+  uniform,
+  gauss,
+  ttl
+} stim_mode;
+
+/**
+
+  Stimulation rate of the zones rasterized on a square texture over the
+  normalized arena, so the rate at a position is a bilinear fetch instead of
+  evaluating the rate function of its zone. Texels just outside each zone
+  carry its rate too, so fetches near the border do not blend with the
+  zero rate outside.
+
+*/
+class StimRateMap
+{
+public:
+    StimRateMap();
+
+    /** Rasterizes the rate of the zones set in zoneMask in the given mode; where
+        zones overlap the first one wins, as in the zone lookup */
+    void build (const StimZoneIndex& zones, const std::vector<char>& zoneMask,
+                stim_mode mode, float freq, float sd);
+
+    /** Stimulation rate (Hz) at (x, y), bilinearly interpolated */
+    float rateAt (float x, float y) const;
+
+private:
+    void paintZone (const StimZoneIndex& zones, int zone, bool interior,
+                    stim_mode mode, float freq, float logSD);
+
+    // Row major, texel (i, j) centered at ((i + 0.5) / RATE_MAP_SIZE, (j + 0.5) / RATE_MAP_SIZE)
+    std::vector<float> m_rates;
+};
+
+#endif // TRACKINGSTIMULATORZONES_H
@@ -40,6 +40,7 @@ TrackingVisualizer::TrackingVisualizer()
     , m_clearTracking(false)
     , m_isRecording(false)
     , m_colorUpdated(false)
+    , m_keypoint(-1)
 {
     setProcessorType (PROCESSOR_TYPE_SINK);
 }
@@ -57,6 +58,8 @@ AudioProcessorEditor *TrackingVisualizer::createEditor()
 void TrackingVisualizer::updateSettings()
 {
     sources.clear();
+    m_sourceTable.clear();
+    m_frameTable.clear();
     TrackingSources s;
     int nEvents = getTotalEventChannels();
     for (int i = 0; i < nEvents; i++)
@@ -72,9 +75,43 @@ void TrackingVisualizer::updateSettings()
             s.y_pos = -1;
             s.width = -1;
             s.height = -1;
+            s.captureTime = 0;
+            // Keypoint channels declare the keypoints following the position
+            s.numKeypoints = 0;
+            s.keypointNames = String();
+            if (event->getMetaDataCount() >= 2)
+            {
+                event->getMetaDataValue(0)->getValue(s.numKeypoints);
+                event->getMetaDataValue(1)->getValue(s.keypointNames);
+            }
+            m_sourceTable[trackingSourceKey (s.sourceId, s.eventIndex)] = sources.size();
             sources.add (s);
             m_colorUpdated = true;
         }
+        else if (event->getName().compare("Tracking frames") == 0)
+        {
+            // One entry per source of the frames, described by the channel metadata
+            int nSources = 0;
+            event->getMetaDataValue(0)->getValue(nSources);
+            m_frameTable[trackingSourceKey (event->getSourceNodeID(), event->getSourceIndex())]
+                = std::make_pair (sources.size(), nSources);
+            for (int k = 0; k < nSources; k++)
+            {
+                s.eventIndex = event->getSourceIndex();
+                s.sourceId =  event->getSourceNodeID();
+                s.name = "Tracking source " + String(k+1);
+                event->getMetaDataValue(1 + 3 * k)->getValue(s.color);
+                s.x_pos = -1;
+                s.y_pos = -1;
+                s.width = -1;
+                s.height = -1;
+                s.captureTime = 0;
+                s.numKeypoints = 0;
+                s.keypointNames = String();
+                sources.add (s);
+            }
+            m_colorUpdated = true;
+        }
     }
 }
 
@@ -93,43 +130,41 @@ void TrackingVisualizer::process(AudioSampleBuffer &)
 
 void TrackingVisualizer::handleEvent (const EventChannel* eventInfo, const MidiMessage& event, int)
 {
-    if ((eventInfo->getName()).compare("Tracking data") != 0)
+    // Only tracking channels are in the tables, so this also filters other events
+    const uint64 key = trackingSourceKey (eventInfo->getSourceNodeID(), eventInfo->getSourceIndex());
+    TrackingSourceTable::const_iterator entry = m_sourceTable.find (key);
+    if (entry != m_sourceTable.end())
     {
-        return;
-    }
-
-    BinaryEventPtr evtptr = BinaryEvent::deserializeFromMessage(event, eventInfo);
+        BinaryEventPtr evtptr = BinaryEvent::deserializeFromMessage(event, eventInfo);
 
-    int nodeId = evtptr->getSourceID();
-    int evtId = evtptr->getSourceIndex();
-    const auto *position = reinterpret_cast<const TrackingPosition *>(evtptr->getBinaryDataPointer());
+        TrackingSources& currentSource = sources.getReference (entry->second);
+        applyTrackingPosition (currentSource, readTrackingPosition (evtptr->getBinaryDataPointer(),
+                                                                    currentSource.numKeypoints, m_keypoint));
 
-    int nSources = sources.size ();
+        String sourceColor;
+        evtptr->getMetaDataValue(0)->getValue(sourceColor);
 
-    for (int i = 0; i < nSources; i++)
+        if (currentSource.color.compare(sourceColor) != 0)
+        {
+            currentSource.color = sourceColor;
+            m_colorUpdated = true;
+        }
+    }
+    else
     {
-        TrackingSources& currentSource = sources.getReference (i);
-        if (currentSource.sourceId == nodeId && evtId == currentSource.eventIndex)
+        TrackingFrameTable::const_iterator frameEntry = m_frameTable.find (key);
+        if (frameEntry == m_frameTable.end())
         {
-            if(!(position->x != position->x || position->y != position->y) && position->x != 0 && position->y != 0)
-            {
-                currentSource.x_pos = position->x;
-                currentSource.y_pos = position->y;
-            }
-            if(!(position->width != position->width || position->height != position->height))
-            {
-                currentSource.width = position->width;
-                currentSource.height = position->height;
-            }
+            return;
+        }
 
-            String sourceColor;
-            evtptr->getMetaDataValue(0)->getValue(sourceColor);
+        BinaryEventPtr evtptr = BinaryEvent::deserializeFromMessage(event, eventInfo);
 
-            if (currentSource.color.compare(sourceColor) != 0)
-            {
-                currentSource.color = sourceColor;
-                m_colorUpdated = true;
-            }
+        const auto *frame = reinterpret_cast<const TrackingFrame *>(evtptr->getBinaryDataPointer());
+        for (int k = 0; k < frameEntry->second.second; k++)
+        {
+            if (frame->validMask & (1u << k))
+                applyTrackingPosition (sources.getReference (frameEntry->second.first + k), frame->positions[k]);
         }
     }
 
@@ -201,6 +236,16 @@ int TrackingVisualizer::getNSources() const
     return sources.size ();
 }
 
+int TrackingVisualizer::getKeypoint() const
+{
+    return m_keypoint;
+}
+
+void TrackingVisualizer::setKeypoint(int keypoint)
+{
+    m_keypoint = keypoint;
+}
+
 void TrackingVisualizer::clearPositionUpdated()
 {
     m_positionIsUpdated = false;
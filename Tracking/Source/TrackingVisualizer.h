@@ -66,6 +66,9 @@ public:
     bool getClearTracking() const;
 
     int getNSources() const;
+    /** Keypoint of the sources displayed instead of their position, -1 for the position */
+    int getKeypoint() const;
+    void setKeypoint(int keypoint);
     TrackingSources& getTrackingSource(int i) const;
 
     void setClearTracking(bool clear);
@@ -78,11 +81,14 @@ public:
 private:
     
     Array<TrackingSources> sources;
+    TrackingSourceTable m_sourceTable;
+    TrackingFrameTable m_frameTable;
 
     bool m_positionIsUpdated;
     bool m_clearTracking;
     bool m_isRecording;
     bool m_colorUpdated;
+    int m_keypoint;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrackingVisualizer);
 };
@@ -165,6 +165,7 @@ void TrackingVisualizerCanvas::resized()
     clearButton->setBounds(0.01*getWidth(), getHeight()-0.05*getHeight(), 0.13*getWidth(), 0.03*getHeight());
     sourcesLabel->setBounds(0.01*getWidth(), getHeight()-0.7*getHeight(), 0.13*getWidth(), 0.03*getHeight());
     listbox->setBounds(0.01*getWidth(), getHeight()-0.65*getHeight(), 0.13*getWidth(), 0.4*getHeight());
+    keypointSelector->setBounds(0.01*getWidth(), getHeight()-0.2*getHeight(), 0.13*getWidth(), 0.03*getHeight());
     refresh();
 }
 
@@ -174,6 +175,16 @@ void TrackingVisualizerCanvas::buttonClicked(Button* button)
         clear();
 }
 
+void TrackingVisualizerCanvas::comboBoxChanged(ComboBox* comboBox)
+{
+    if (comboBox == keypointSelector)
+    {
+        // First item is the position of the sources
+        processor->setKeypoint(comboBox->getSelectedId() - 2);
+        clear();
+    }
+}
+
 void TrackingVisualizerCanvas::refreshState()
 {
 
@@ -194,6 +205,19 @@ void TrackingVisualizerCanvas::update()
     listbox->setData(listboxData);
     listbox->updateContent();
 
+    // Keypoints of the sources that have some, named after the first one
+    keypointSelector->clear();
+    keypointSelector->addItem("Position", 1);
+    int nKeypoints = 0;
+    for (int i = 0; i < nSources; i++)
+    {
+        TrackingSources& source = processor->getTrackingSource(i);
+        for (int k = nKeypoints; k < source.numKeypoints; k++)
+            keypointSelector->addItem(getKeypointName(source, k), k + 2);
+        nKeypoints = jmax(nKeypoints, source.numKeypoints);
+    }
+    keypointSelector->setSelectedId(processor->getKeypoint()+2, dontSendNotification);
+
 }
 
 void TrackingVisualizerCanvas::refresh()
@@ -259,6 +283,13 @@ void TrackingVisualizerCanvas::initButtonsAndLabels()
     listbox = new SourceListBox();
     addAndMakeVisible(listbox);
 
+    keypointSelector = new ComboBox("Keypoints");
+    keypointSelector->setEditableText(false);
+    keypointSelector->setJustificationType(Justification::centredLeft);
+    keypointSelector->setTooltip("Display the position of the sources, or one of their keypoints");
+    keypointSelector->addListener(this);
+    addAndMakeVisible(keypointSelector);
+
     // Static Labels
     sourcesLabel = new Label("s_sources", "Sources");
     sourcesLabel->setFont(Font(28));
@@ -58,7 +58,8 @@ private:
 
 
 class TrackingVisualizerCanvas : public Visualizer,
-        public Button::Listener
+        public Button::Listener,
+        public ComboBox::Listener
 {
 public:
     TrackingVisualizerCanvas(TrackingVisualizer* TrackingVisualizer);
@@ -71,6 +72,9 @@ public:
     // Button Listener interface
     virtual void buttonClicked(Button* button);
 
+    // ComboBox Listener interface
+    virtual void comboBoxChanged(ComboBox* comboBox);
+
     // Visualizer interface
     virtual void refreshState();
     virtual void update();
@@ -90,6 +94,7 @@ private:
 
     ScopedPointer<SourceListBox> listbox;
     ScopedPointer<UtilityButton> clearButton;
+    ScopedPointer<ComboBox> keypointSelector;
     ScopedPointer<UtilityButton> sameButton;
     ScopedPointer<Label> sourcesLabel;
 
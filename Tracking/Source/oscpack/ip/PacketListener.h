@@ -38,13 +38,25 @@
 #define INCLUDED_OSCPACK_PACKETLISTENER_H
 
 
-class IpEndpointName;
+#include "IpEndpointName.h"
 
 class PacketListener{
 public:
     virtual ~PacketListener() {}
     virtual void ProcessPacket( const char *data, int size, 
 			const IpEndpointName& remoteEndpoint ) = 0;
+
+    // called by SocketReceiveMultiplexer with the datagrams drained from a
+    // socket at once. receiveTimesNs holds their kernel receive times in
+    // nanoseconds since the epoch, 0 where not available. the default
+    // implementation processes them in arrival order with ProcessPacket().
+    virtual void ProcessPacketBatch( const char * const *data, const int *sizes,
+            const IpEndpointName *remoteEndpoints, const long long *receiveTimesNs, int count )
+    {
+        (void) receiveTimesNs;
+        for( int i = 0; i < count; ++i )
+            ProcessPacket( data[i], sizes[i], remoteEndpoints[i] );
+    }
 };
 
 #endif /* INCLUDED_OSCPACK_PACKETLISTENER_H */
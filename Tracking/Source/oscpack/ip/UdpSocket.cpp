@@ -58,6 +58,12 @@
 #include <sys/time.h>
 #include <netinet/in.h> // for sockaddr_in
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#define OSCPACK_USE_EPOLL 1
+#define OSCPACK_USE_RECVMMSG 1
+#endif
+
 #include <signal.h>
 #include <math.h>
 #include <errno.h>
@@ -68,6 +74,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring> // for memset
+#include <mutex>
 #include <stdexcept>
 #include <vector>
 
@@ -161,6 +168,23 @@ public:
         setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &reuseAddr, sizeof(reuseAddr));
     }
 
+    int SetReceiveBufferSize( int bytes )
+    {
+        if( setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, (const char*)&bytes, sizeof(bytes)) != 0 )
+            return -1;
+
+        int granted = 0;
+        int grantedLen = sizeof(granted);
+        if( getsockopt(socket_, SOL_SOCKET, SO_RCVBUF, (char*)&granted, &grantedLen) != 0 )
+            return -1;
+        return granted;
+    }
+
+    bool SetBusyPoll( int )
+    {
+        return false;
+    }
+
     IpEndpointName LocalEndpointFor( const IpEndpointName& remoteEndpoint ) const
     {
         assert( isBound_ );
@@ -263,6 +287,29 @@ public:
         return result;
     }
 
+    bool SetReceiveTimestamps( bool )
+    {
+        // no kernel receive timestamps on win32
+        return false;
+    }
+
+    std::size_t ReceiveBatchFrom( IpEndpointName *remoteEndpoints, char *data, std::size_t slotSize,
+            int *sizes, long long *receiveTimesNs, std::size_t maxCount )
+    {
+        // no batched receive on win32, one datagram per call
+        if( maxCount == 0 )
+            return 0;
+
+        std::size_t size = ReceiveFrom( remoteEndpoints[0], data, slotSize );
+        if( size == 0 )
+            return 0;
+
+        sizes[0] = (int)size;
+        if( receiveTimesNs )
+            receiveTimesNs[0] = 0;
+        return 1;
+    }
+
     SOCKET& Socket() { return socket_; }
 };
 
@@ -286,6 +333,16 @@ void UdpSocket::SetAllowReuse( bool allowReuse )
     impl_->SetAllowReuse( allowReuse );
 }
 
+int UdpSocket::SetReceiveBufferSize( int bytes )
+{
+    return impl_->SetReceiveBufferSize( bytes );
+}
+
+bool UdpSocket::SetBusyPoll( int microseconds )
+{
+    return impl_->SetBusyPoll( microseconds );
+}
+
 IpEndpointName UdpSocket::LocalEndpointFor( const IpEndpointName& remoteEndpoint ) const
 {
     return impl_->LocalEndpointFor( remoteEndpoint );
@@ -321,6 +378,17 @@ std::size_t UdpSocket::ReceiveFrom( IpEndpointName& remoteEndpoint, char *data,
     return impl_->ReceiveFrom( remoteEndpoint, data, size );
 }
 
+std::size_t UdpSocket::ReceiveBatchFrom( IpEndpointName *remoteEndpoints, char *data, std::size_t slotSize,
+        int *sizes, long long *receiveTimesNs, std::size_t maxCount )
+{
+    return impl_->ReceiveBatchFrom( remoteEndpoints, data, slotSize, sizes, receiveTimesNs, maxCount );
+}
+
+bool UdpSocket::SetReceiveTimestamps( bool enable )
+{
+    return impl_->SetReceiveTimestamps( enable );
+}
+
 
 struct AttachedTimerListener{
     AttachedTimerListener( int id, int p, TimerListener *tl )
@@ -358,6 +426,15 @@ class SocketReceiveMultiplexer::Implementation{
     std::vector< std::pair< PacketListener*, UdpSocket* > > socketListeners_;
     std::vector< AttachedTimerListener > timerListeners_;
 
+    // socket listeners may be attached and detached while Run() is active;
+    // the mutex is held while a packet is dispatched, so once Detach returns
+    // the listener will not be called again.
+    std::recursive_mutex socketListenersMutex_;
+    volatile bool socketListenersChanged_;
+
+    // win32 has no batched receive, kept for interface parity
+    int receiveBatchSize_;
+
     volatile bool break_;
     HANDLE breakEvent_;
 
@@ -372,6 +449,8 @@ class SocketReceiveMultiplexer::Implementation{
 
 public:
     Implementation()
+        : socketListenersChanged_( false )
+        , receiveBatchSize_( 1 )
     {
         breakEvent_ = CreateEvent( NULL, FALSE, FALSE, NULL );
     }
@@ -383,18 +462,34 @@ public:
 
     void AttachSocketListener( UdpSocket *socket, PacketListener *listener )
     {
+        std::lock_guard< std::recursive_mutex > lock( socketListenersMutex_ );
+
         assert( std::find( socketListeners_.begin(), socketListeners_.end(), std::make_pair(listener, socket) ) == socketListeners_.end() );
         // we don't check that the same socket has been added multiple times, even though this is an error
         socketListeners_.push_back( std::make_pair( listener, socket ) );
+
+        // wake up Run() so that it rebuilds its event set
+        socketListenersChanged_ = true;
+        SetEvent( breakEvent_ );
     }
 
     void DetachSocketListener( UdpSocket *socket, PacketListener *listener )
     {
+        std::lock_guard< std::recursive_mutex > lock( socketListenersMutex_ );
+
         std::vector< std::pair< PacketListener*, UdpSocket* > >::iterator i =
                 std::find( socketListeners_.begin(), socketListeners_.end(), std::make_pair(listener, socket) );
         assert( i != socketListeners_.end() );
 
         socketListeners_.erase( i );
+
+        socketListenersChanged_ = true;
+        SetEvent( breakEvent_ );
+    }
+
+    void SetReceiveBatchSize( int maxDatagrams )
+    {
+        receiveBatchSize_ = (maxDatagrams < 1) ? 1 : maxDatagrams;
     }
 
     void AttachPeriodicTimerListener( int periodMilliseconds, TimerListener *listener )
@@ -421,26 +516,48 @@ public:
         timerListeners_.erase( i );
     }
 
-    void Run()
+    void FreeEvents( std::vector<HANDLE>& events, std::vector<SOCKET>& sockets )
     {
-        break_ = false;
-
-        // prepare the window events which we use to wake up on incoming data
-        // we use this instead of select() primarily to support the AsyncBreak()
-        // mechanism.
+        for( std::size_t j = 0; j < sockets.size(); ++j ){
+            WSAEventSelect( sockets[j], events[j], 0 ); // remove association between socket and event
+            CloseHandle( events[j] );
+            unsigned long enableNonblocking = 0;
+            ioctlsocket( sockets[j], FIONBIO, &enableNonblocking );  // make the socket blocking again
+        }
+        events.clear();
+        sockets.clear();
+    }
 
-        std::vector<HANDLE> events( socketListeners_.size() + 1, 0 );
-        int j=0;
+    void CreateEvents( std::vector<HANDLE>& events, std::vector<SOCKET>& sockets )
+    {
         for( std::vector< std::pair< PacketListener*, UdpSocket* > >::iterator i = socketListeners_.begin();
-                i != socketListeners_.end(); ++i, ++j ){
+                i != socketListeners_.end(); ++i ){
 
             HANDLE event = CreateEvent( NULL, FALSE, FALSE, NULL );
             WSAEventSelect( i->second->impl_->Socket(), event, FD_READ ); // note that this makes the socket non-blocking which is why we can safely call RecieveFrom() on all sockets below
-            events[j] = event;
+            events.push_back( event );
+            sockets.push_back( i->second->impl_->Socket() );
         }
 
+        events.push_back( breakEvent_ ); // last event in the collection is the break event
+    }
 
-        events[ socketListeners_.size() ] = breakEvent_; // last event in the collection is the break event
+    void Run()
+    {
+        break_ = false;
+
+        // prepare the window events which we use to wake up on incoming data
+        // we use this instead of select() primarily to support the AsyncBreak()
+        // mechanism. the events are rebuilt whenever a socket listener is attached
+        // or detached while we are running.
+
+        std::vector<HANDLE> events;
+        std::vector<SOCKET> sockets;
+        {
+            std::lock_guard< std::recursive_mutex > lock( socketListenersMutex_ );
+            CreateEvents( events, sockets );
+            socketListenersChanged_ = false;
+        }
 
 
         // configure the timer queue
@@ -469,17 +586,27 @@ public:
                             : 0 );
             }
 
-            DWORD waitResult = WaitForMultipleObjects( (DWORD)socketListeners_.size() + 1, &events[0], FALSE, waitTime );
+            DWORD waitResult = WaitForMultipleObjects( (DWORD)events.size(), &events[0], FALSE, waitTime );
             if( break_ )
                 break;
 
-            if( waitResult != WAIT_TIMEOUT ){
-                for( int i = waitResult - WAIT_OBJECT_0; i < (int)socketListeners_.size(); ++i ){
-                    std::size_t size = socketListeners_[i].second->ReceiveFrom( remoteEndpoint, data, MAX_BUFFER_SIZE );
-                    if( size > 0 ){
-                        socketListeners_[i].first->ProcessPacket( data, (int)size, remoteEndpoint );
-                        if( break_ )
-                            break;
+            {
+                std::lock_guard< std::recursive_mutex > lock( socketListenersMutex_ );
+
+                if( socketListenersChanged_ ){
+                    // pending data is re-signalled by WSAEventSelect() on the new events
+                    FreeEvents( events, sockets );
+                    CreateEvents( events, sockets );
+                    socketListenersChanged_ = false;
+                }
+                else if( waitResult != WAIT_TIMEOUT ){
+                    for( int i = waitResult - WAIT_OBJECT_0; i < (int)socketListeners_.size(); ++i ){
+                        std::size_t size = socketListeners_[i].second->ReceiveFrom( remoteEndpoint, data, MAX_BUFFER_SIZE );
+                        if( size > 0 ){
+                            socketListeners_[i].first->ProcessPacket( data, (int)size, remoteEndpoint );
+                            if( break_ )
+                                break;
+                        }
                     }
                 }
             }
@@ -504,14 +631,9 @@ public:
         delete [] data;
 
         // free events
-        j = 0;
-        for( std::vector< std::pair< PacketListener*, UdpSocket* > >::iterator i = socketListeners_.begin();
-                i != socketListeners_.end(); ++i, ++j ){
-
-            WSAEventSelect( i->second->impl_->Socket(), events[j], 0 ); // remove association between socket and event
-            CloseHandle( events[j] );
-            unsigned long enableNonblocking = 0;
-            ioctlsocket( i->second->impl_->Socket(), FIONBIO, &enableNonblocking );  // make the socket blocking again
+        {
+            std::lock_guard< std::recursive_mutex > lock( socketListenersMutex_ );
+            FreeEvents( events, sockets );
         }
     }
 
@@ -549,6 +671,11 @@ void SocketReceiveMultiplexer::DetachSocketListener( UdpSocket *socket, PacketLi
     impl_->DetachSocketListener( socket, listener );
 }
 
+void SocketReceiveMultiplexer::SetReceiveBatchSize( int maxDatagrams )
+{
+    impl_->SetReceiveBatchSize( maxDatagrams );
+}
+
 void SocketReceiveMultiplexer::AttachPeriodicTimerListener( int periodMilliseconds, TimerListener *listener )
 {
     impl_->AttachPeriodicTimerListener( periodMilliseconds, listener );
@@ -641,12 +768,37 @@ class UdpSocket::Implementation{
     struct sockaddr_in connectedAddr_;
     struct sockaddr_in sendToAddr_;
 
+    bool receiveTimestamps_;
+
+#ifdef OSCPACK_USE_RECVMMSG
+    // room for one SCM_TIMESTAMPNS control message per datagram
+    enum { CONTROL_BUFFER_SIZE = 64 };
+
+    std::vector< struct mmsghdr > batchHeaders_;
+    std::vector< struct iovec > batchIovecs_;
+    std::vector< struct sockaddr_in > batchAddrs_;
+    std::vector< char > batchControl_;
+
+    static long long ReceiveTimeFromControl( struct msghdr& header )
+    {
+        for( struct cmsghdr *cmsg = CMSG_FIRSTHDR( &header ); cmsg != 0; cmsg = CMSG_NXTHDR( &header, cmsg ) ){
+            if( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS ){
+                struct timespec ts;
+                std::memcpy( &ts, CMSG_DATA( cmsg ), sizeof(ts) );
+                return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+            }
+        }
+        return 0;
+    }
+#endif
+
 public:
 
     Implementation()
         : isBound_( false )
         , isConnected_( false )
         , socket_( -1 )
+        , receiveTimestamps_( false )
     {
         if( (socket_ = socket( AF_INET, SOCK_DGRAM, 0 )) == -1 ){
             throw std::runtime_error("unable to create udp socket\n");
@@ -679,6 +831,29 @@ public:
 #endif
     }
 
+    int SetReceiveBufferSize( int bytes )
+    {
+        if( setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) != 0 )
+            return -1;
+
+        // Linux reports twice the requested size, to account for its bookkeeping
+        int granted = 0;
+        socklen_t grantedLen = sizeof(granted);
+        if( getsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &granted, &grantedLen) != 0 )
+            return -1;
+        return granted;
+    }
+
+    bool SetBusyPoll( int microseconds )
+    {
+#ifdef SO_BUSY_POLL
+        return setsockopt(socket_, SOL_SOCKET, SO_BUSY_POLL, &microseconds, sizeof(microseconds)) == 0;
+#else
+        (void) microseconds;
+        return false;
+#endif
+    }
+
     IpEndpointName LocalEndpointFor( const IpEndpointName& remoteEndpoint ) const
     {
         assert( isBound_ );
@@ -782,6 +957,97 @@ public:
         return (std::size_t)result;
     }
 
+    bool SetReceiveTimestamps( bool enable )
+    {
+#ifdef SO_TIMESTAMPNS
+        int on = (enable) ? 1 : 0;
+        if( setsockopt( socket_, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on) ) != 0 )
+            return false;
+        receiveTimestamps_ = enable;
+        return true;
+#else
+        (void) enable;
+        return false;
+#endif
+    }
+
+    std::size_t ReceiveBatchFrom( IpEndpointName *remoteEndpoints, char *data, std::size_t slotSize,
+            int *sizes, long long *receiveTimesNs, std::size_t maxCount )
+    {
+        assert( isBound_ );
+
+#ifdef OSCPACK_USE_RECVMMSG
+        // the headers are only (re)allocated when the batch size grows
+        if( batchHeaders_.size() < maxCount ){
+            batchHeaders_.resize( maxCount );
+            batchIovecs_.resize( maxCount );
+            batchAddrs_.resize( maxCount );
+            batchControl_.resize( maxCount * CONTROL_BUFFER_SIZE );
+        }
+
+        for( std::size_t i = 0; i < maxCount; ++i ){
+            batchIovecs_[i].iov_base = data + i * slotSize;
+            batchIovecs_[i].iov_len = slotSize;
+
+            std::memset( &batchHeaders_[i], 0, sizeof(batchHeaders_[i]) );
+            batchHeaders_[i].msg_hdr.msg_iov = &batchIovecs_[i];
+            batchHeaders_[i].msg_hdr.msg_iovlen = 1;
+            batchHeaders_[i].msg_hdr.msg_name = &batchAddrs_[i];
+            batchHeaders_[i].msg_hdr.msg_namelen = sizeof(batchAddrs_[i]);
+            if( receiveTimestamps_ ){
+                batchHeaders_[i].msg_hdr.msg_control = &batchControl_[i * CONTROL_BUFFER_SIZE];
+                batchHeaders_[i].msg_hdr.msg_controllen = CONTROL_BUFFER_SIZE;
+            }
+        }
+
+        int result = recvmmsg( socket_, &batchHeaders_[0], (unsigned int)maxCount, MSG_DONTWAIT, 0 );
+        if( result <= 0 )
+            return 0;
+
+        // datagrams longer than a slot are discarded, and the following ones moved
+        // down so that datagram i still starts at data + i * slotSize
+        std::size_t count = 0;
+        for( int i = 0; i < result; ++i ){
+            if( batchHeaders_[i].msg_hdr.msg_flags & MSG_TRUNC )
+                continue;
+
+            if( count != (std::size_t)i )
+                std::memmove( data + count * slotSize, data + i * slotSize, batchHeaders_[i].msg_len );
+            remoteEndpoints[count].address = ntohl( batchAddrs_[i].sin_addr.s_addr );
+            remoteEndpoints[count].port = ntohs( batchAddrs_[i].sin_port );
+            sizes[count] = (int)batchHeaders_[i].msg_len;
+            if( receiveTimesNs )
+                receiveTimesNs[count] = ReceiveTimeFromControl( batchHeaders_[i].msg_hdr );
+            ++count;
+        }
+
+        return count;
+#else
+        std::size_t count = 0;
+        for( std::size_t i = 0; i < maxCount; ++i ){
+            struct sockaddr_in fromAddr;
+            socklen_t fromAddrLen = sizeof(fromAddr);
+
+            // MSG_TRUNC returns the full length, so that longer datagrams are discarded
+            ssize_t result = recvfrom(socket_, data + count * slotSize, slotSize, MSG_DONTWAIT | MSG_TRUNC,
+                        (struct sockaddr *) &fromAddr, (socklen_t*)&fromAddrLen);
+            if( result < 0 )
+                break;
+            if( (std::size_t)result > slotSize )
+                continue;
+
+            remoteEndpoints[count].address = ntohl(fromAddr.sin_addr.s_addr);
+            remoteEndpoints[count].port = ntohs(fromAddr.sin_port);
+            sizes[count] = (int)result;
+            if( receiveTimesNs )
+                receiveTimesNs[count] = 0;
+            ++count;
+        }
+
+        return count;
+#endif
+    }
+
     int Socket() { return socket_; }
 };
 
@@ -805,6 +1071,16 @@ void UdpSocket::SetAllowReuse( bool allowReuse )
     impl_->SetAllowReuse( allowReuse );
 }
 
+int UdpSocket::SetReceiveBufferSize( int bytes )
+{
+    return impl_->SetReceiveBufferSize( bytes );
+}
+
+bool UdpSocket::SetBusyPoll( int microseconds )
+{
+    return impl_->SetBusyPoll( microseconds );
+}
+
 IpEndpointName UdpSocket::LocalEndpointFor( const IpEndpointName& remoteEndpoint ) const
 {
     return impl_->LocalEndpointFor( remoteEndpoint );
@@ -840,6 +1116,17 @@ std::size_t UdpSocket::ReceiveFrom( IpEndpointName& remoteEndpoint, char *data,
     return impl_->ReceiveFrom( remoteEndpoint, data, size );
 }
 
+std::size_t UdpSocket::ReceiveBatchFrom( IpEndpointName *remoteEndpoints, char *data, std::size_t slotSize,
+        int *sizes, long long *receiveTimesNs, std::size_t maxCount )
+{
+    return impl_->ReceiveBatchFrom( remoteEndpoints, data, slotSize, sizes, receiveTimesNs, maxCount );
+}
+
+bool UdpSocket::SetReceiveTimestamps( bool enable )
+{
+    return impl_->SetReceiveTimestamps( enable );
+}
+
 
 struct AttachedTimerListener{
     AttachedTimerListener( int id, int p, TimerListener *tl )
@@ -873,9 +1160,21 @@ class SocketReceiveMultiplexer::Implementation{
     std::vector< std::pair< PacketListener*, UdpSocket* > > socketListeners_;
     std::vector< AttachedTimerListener > timerListeners_;
 
+    // socket listeners may be attached and detached while Run() is active;
+    // the mutex is held while a packet is dispatched, so once Detach returns
+    // the listener will not be called again.
+    std::recursive_mutex socketListenersMutex_;
+
+    // number of datagrams read from a ready socket in one call
+    int receiveBatchSize_;
+
     volatile bool break_;
     int breakPipe_[2]; // [0] is the reader descriptor and [1] the writer
 
+#ifdef OSCPACK_USE_EPOLL
+    int epollFd_;
+#endif
+
     double GetCurrentTimeMs() const
     {
         struct timeval t;
@@ -885,33 +1184,98 @@ class SocketReceiveMultiplexer::Implementation{
         return ((double)t.tv_sec*1000.) + ((double)t.tv_usec / 1000.);
     }
 
+    // wake up Run() without breaking, so that it picks up attached/detached sockets
+    void WakeUp()
+    {
+        write( breakPipe_[1], "", 1 );
+    }
+
+    std::pair< PacketListener*, UdpSocket* > *FindSocketListener( int fd )
+    {
+        for( std::vector< std::pair< PacketListener*, UdpSocket* > >::iterator i = socketListeners_.begin();
+                i != socketListeners_.end(); ++i ){
+            if( i->second->impl_->Socket() == fd )
+                return &(*i);
+        }
+        return 0;
+    }
+
 public:
     Implementation()
+        : receiveBatchSize_( 1 )
     {
         if( pipe(breakPipe_) != 0 )
             throw std::runtime_error( "creation of asynchronous break pipes failed\n" );
+
+#ifdef OSCPACK_USE_EPOLL
+        if( (epollFd_ = epoll_create1( EPOLL_CLOEXEC )) == -1 ){
+            close( breakPipe_[0] );
+            close( breakPipe_[1] );
+            throw std::runtime_error( "creation of epoll instance failed\n" );
+        }
+
+        // in addition to listening to the inbound sockets we
+        // also listen to the asynchronous break pipe, so that AsynchronousBreak()
+        // can break us out of epoll_wait() from another thread.
+        struct epoll_event event;
+        std::memset( &event, 0, sizeof(event) );
+        event.events = EPOLLIN;
+        event.data.fd = breakPipe_[0];
+        epoll_ctl( epollFd_, EPOLL_CTL_ADD, breakPipe_[0], &event );
+#endif
     }
 
     ~Implementation()
     {
+#ifdef OSCPACK_USE_EPOLL
+        close( epollFd_ );
+#endif
         close( breakPipe_[0] );
         close( breakPipe_[1] );
     }
 
     void AttachSocketListener( UdpSocket *socket, PacketListener *listener )
     {
+        std::lock_guard< std::recursive_mutex > lock( socketListenersMutex_ );
+
         assert( std::find( socketListeners_.begin(), socketListeners_.end(), std::make_pair(listener, socket) ) == socketListeners_.end() );
         // we don't check that the same socket has been added multiple times, even though this is an error
         socketListeners_.push_back( std::make_pair( listener, socket ) );
+
+#ifdef OSCPACK_USE_EPOLL
+        struct epoll_event event;
+        std::memset( &event, 0, sizeof(event) );
+        event.events = EPOLLIN;
+        event.data.fd = socket->impl_->Socket();
+        if( epoll_ctl( epollFd_, EPOLL_CTL_ADD, event.data.fd, &event ) != 0 ){
+            socketListeners_.pop_back();
+            throw std::runtime_error( "unable to add socket to epoll set\n" );
+        }
+#else
+        WakeUp();
+#endif
     }
 
     void DetachSocketListener( UdpSocket *socket, PacketListener *listener )
     {
+        std::lock_guard< std::recursive_mutex > lock( socketListenersMutex_ );
+
         std::vector< std::pair< PacketListener*, UdpSocket* > >::iterator i =
                 std::find( socketListeners_.begin(), socketListeners_.end(), std::make_pair(listener, socket) );
         assert( i != socketListeners_.end() );
 
         socketListeners_.erase( i );
+
+#ifdef OSCPACK_USE_EPOLL
+        epoll_ctl( epollFd_, EPOLL_CTL_DEL, socket->impl_->Socket(), 0 );
+#else
+        WakeUp();
+#endif
+    }
+
+    void SetReceiveBatchSize( int maxDatagrams )
+    {
+        receiveBatchSize_ = (maxDatagrams < 1) ? 1 : maxDatagrams;
     }
 
     void AttachPeriodicTimerListener( int periodMilliseconds, TimerListener *listener )
@@ -945,27 +1309,6 @@ public:
 
         try{
 
-            // configure the master fd_set for select()
-
-            fd_set masterfds, tempfds;
-            FD_ZERO( &masterfds );
-            FD_ZERO( &tempfds );
-
-            // in addition to listening to the inbound sockets we
-            // also listen to the asynchronous break pipe, so that AsynchronousBreak()
-            // can break us out of select() from another thread.
-            FD_SET( breakPipe_[0], &masterfds );
-            int fdmax = breakPipe_[0];
-
-            for( std::vector< std::pair< PacketListener*, UdpSocket* > >::iterator i = socketListeners_.begin();
-                    i != socketListeners_.end(); ++i ){
-
-                if( fdmax < i->second->impl_->Socket() )
-                    fdmax = i->second->impl_->Socket();
-                FD_SET( i->second->impl_->Socket(), &masterfds );
-            }
-
-
             // configure the timer queue
             double currentTimeMs = GetCurrentTimeMs();
 
@@ -976,21 +1319,79 @@ public:
                 timerQueue_.push_back( std::make_pair( currentTimeMs + i->initialDelayMs, *i ) );
             std::sort( timerQueue_.begin(), timerQueue_.end(), CompareScheduledTimerCalls );
 
+            // one slot per datagram of a batch, allocated once for the whole run
             const int MAX_BUFFER_SIZE = 4098;
-            data = new char[ MAX_BUFFER_SIZE ];
-            IpEndpointName remoteEndpoint;
-
+            const int batchSize = receiveBatchSize_;
+            data = new char[ MAX_BUFFER_SIZE * batchSize ];
+            std::vector< const char* > packets( batchSize );
+            std::vector< int > sizes( batchSize );
+            std::vector< IpEndpointName > remoteEndpoints( batchSize );
+            std::vector< long long > receiveTimes( batchSize );
+            for( int i = 0; i < batchSize; ++i )
+                packets[i] = data + i * MAX_BUFFER_SIZE;
+
+            // descriptors reported readable by the last wait
+            std::vector< int > readyFds;
+            readyFds.reserve( 64 );
+
+#ifdef OSCPACK_USE_EPOLL
+            const int MAX_EVENTS = 64;
+            struct epoll_event events[ MAX_EVENTS ];
+#else
+            fd_set tempfds;
             struct timeval timeout;
+#endif
 
             while( !break_ ){
-                tempfds = masterfds;
 
-                struct timeval *timeoutPtr = 0;
+                double timeoutMs = -1;
                 if( !timerQueue_.empty() ){
-                    double timeoutMs = timerQueue_.front().first - GetCurrentTimeMs();
+                    timeoutMs = timerQueue_.front().first - GetCurrentTimeMs();
                     if( timeoutMs < 0 )
                         timeoutMs = 0;
+                }
+
+                readyFds.clear();
+                bool breakPipeReady = false;
 
+#ifdef OSCPACK_USE_EPOLL
+                int eventCount = epoll_wait( epollFd_, events, MAX_EVENTS,
+                        (timeoutMs < 0) ? -1 : (int)ceil( timeoutMs ) );
+                if( eventCount < 0 ){
+                    if( break_ ){
+                        break;
+                    }else if( errno == EINTR ){
+                        continue;
+                    }else{
+                        throw std::runtime_error("epoll_wait failed\n");
+                    }
+                }
+
+                for( int i = 0; i < eventCount; ++i ){
+                    if( events[i].data.fd == breakPipe_[0] )
+                        breakPipeReady = true;
+                    else
+                        readyFds.push_back( events[i].data.fd );
+                }
+#else
+                // the fd_set is rebuilt on every pass because sockets may have been
+                // attached or detached since the last one.
+                FD_ZERO( &tempfds );
+                FD_SET( breakPipe_[0], &tempfds );
+                int fdmax = breakPipe_[0];
+                {
+                    std::lock_guard< std::recursive_mutex > lock( socketListenersMutex_ );
+                    for( std::vector< std::pair< PacketListener*, UdpSocket* > >::iterator i = socketListeners_.begin();
+                            i != socketListeners_.end(); ++i ){
+
+                        if( fdmax < i->second->impl_->Socket() )
+                            fdmax = i->second->impl_->Socket();
+                        FD_SET( i->second->impl_->Socket(), &tempfds );
+                    }
+                }
+
+                struct timeval *timeoutPtr = 0;
+                if( timeoutMs >= 0 ){
                     long timoutSecondsPart = (long)(timeoutMs * .001);
                     timeout.tv_sec = (time_t)timoutSecondsPart;
                     // 1000000 microseconds in a second
@@ -1012,7 +1413,14 @@ public:
                     }
                 }
 
-                if( FD_ISSET( breakPipe_[0], &tempfds ) ){
+                breakPipeReady = FD_ISSET( breakPipe_[0], &tempfds );
+                for( int fd = 0; fd <= fdmax; ++fd ){
+                    if( fd != breakPipe_[0] && FD_ISSET( fd, &tempfds ) )
+                        readyFds.push_back( fd );
+                }
+#endif
+
+                if( breakPipeReady ){
                     // clear pending data from the asynchronous break pipe
                     char c;
                     read( breakPipe_[0], &c, 1 );
@@ -1021,18 +1429,23 @@ public:
                 if( break_ )
                     break;
 
-                for( std::vector< std::pair< PacketListener*, UdpSocket* > >::iterator i = socketListeners_.begin();
-                        i != socketListeners_.end(); ++i ){
+                for( std::vector< int >::iterator fd = readyFds.begin(); fd != readyFds.end(); ++fd ){
 
-                    if( FD_ISSET( i->second->impl_->Socket(), &tempfds ) ){
+                    std::lock_guard< std::recursive_mutex > lock( socketListenersMutex_ );
 
-                        std::size_t size = i->second->ReceiveFrom( remoteEndpoint, data, MAX_BUFFER_SIZE );
-                        if( size > 0 ){
-                            i->first->ProcessPacket( data, (int)size, remoteEndpoint );
-                            if( break_ )
-                                break;
-                        }
+                    // the socket may have been detached since the wait returned
+                    std::pair< PacketListener*, UdpSocket* > *socketListener = FindSocketListener( *fd );
+                    if( !socketListener )
+                        continue;
+
+                    std::size_t count = socketListener->second->ReceiveBatchFrom(
+                            &remoteEndpoints[0], data, MAX_BUFFER_SIZE, &sizes[0], &receiveTimes[0], batchSize );
+                    if( count > 0 ){
+                        socketListener->first->ProcessPacketBatch(
+                                &packets[0], &sizes[0], &remoteEndpoints[0], &receiveTimes[0], (int)count );
                     }
+                    if( break_ )
+                        break;
                 }
 
                 // execute any expired timers
@@ -1096,6 +1509,11 @@ void SocketReceiveMultiplexer::DetachSocketListener( UdpSocket *socket, PacketLi
     impl_->DetachSocketListener( socket, listener );
 }
 
+void SocketReceiveMultiplexer::SetReceiveBatchSize( int maxDatagrams )
+{
+    impl_->SetReceiveBatchSize( maxDatagrams );
+}
+
 void SocketReceiveMultiplexer::AttachPeriodicTimerListener( int periodMilliseconds, TimerListener *listener )
 {
     impl_->AttachPeriodicTimerListener( periodMilliseconds, listener );
@@ -58,12 +58,22 @@ public:
     SocketReceiveMultiplexer();
     ~SocketReceiveMultiplexer();
 
-	// only call the attach/detach methods _before_ calling Run
+	// socket listeners may be attached and detached from any thread, also while
+	// Run is active. once DetachSocketListener returns the listener will not be
+	// called again. timer listeners must still be attached _before_ calling Run.
+	// on Linux the multiplexer waits with epoll(), elsewhere with select() or
+	// WaitForMultipleObjects().
 
     // only one listener per socket, each socket at most once
     void AttachSocketListener( UdpSocket *socket, PacketListener *listener );
     void DetachSocketListener( UdpSocket *socket, PacketListener *listener );
 
+    // maximum number of datagrams drained from a ready socket before they are
+    // handed to PacketListener::ProcessPacketBatch(). on Linux they are read
+    // with a single recvmmsg() call into a preallocated slab, along with their
+    // kernel receive times if enabled on the socket. call before Run.
+    void SetReceiveBatchSize( int maxDatagrams );
+
     void AttachPeriodicTimerListener( int periodMilliseconds, TimerListener *listener );
 	void AttachPeriodicTimerListener(
             int initialDelayMilliseconds, int periodMilliseconds, TimerListener *listener );
@@ -102,6 +112,14 @@ public:
 	// operating systems.
 	void SetAllowReuse( bool allowReuse );
 
+    // Sets SO_RCVBUF. Returns the size the system actually granted (which may
+    // be capped, e.g. by net.core.rmem_max on Linux), or -1 on failure.
+    int SetReceiveBufferSize( int bytes );
+
+    // Sets SO_BUSY_POLL: the kernel busy-polls the device for up to the given
+    // time on blocking receives. Returns false where not supported.
+    bool SetBusyPoll( int microseconds );
+
 
 	// The socket is created in an unbound, unconnected state
 	// such a socket can only be used to send to an arbitrary
@@ -126,6 +144,18 @@ public:
 	bool IsBound() const;
 
     std::size_t ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, std::size_t size );
+
+    // Ask the kernel to timestamp received datagrams (SO_TIMESTAMPNS). Returns
+    // false where this is not supported.
+    bool SetReceiveTimestamps( bool enable );
+
+    // Receive up to maxCount datagrams without blocking once the first one is
+    // read. datagram i is stored at data + i * slotSize. receiveTimesNs, if not
+    // null, gets the kernel receive time of each datagram in nanoseconds since
+    // the epoch, or 0 when it is not available. Datagrams longer than slotSize
+    // are discarded. Returns the number of datagrams received.
+    std::size_t ReceiveBatchFrom( IpEndpointName *remoteEndpoints, char *data, std::size_t slotSize,
+            int *sizes, long long *receiveTimesNs, std::size_t maxCount );
 };
 
 